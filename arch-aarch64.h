@@ -28,6 +28,8 @@
 
 #include "compiler.h"
 #include "crt.h"
+#include "sys/auxv.h"
+#include <linux/auxvec.h>
 
 /* Syscalls for AARCH64 :
  *   - registers are 64-bit
@@ -169,4 +171,393 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	);
 	__nolibc_entrypoint_epilogue();
 }
+
+/* unaligned word accesses are about as fast as aligned ones */
+#define NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+
+#define NOLIBC_ARCH_HAS_MEMMOVE
+void *memmove(void *dst, const void *src, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMCPY
+void *memcpy(void *dst, const void *src, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMSET
+void *memset(void *dst, int c, size_t len);
+
+/* memmove() and memcpy() are the same function. Up to 128 bytes, the whole
+ * area is loaded into registers, using a first and a last block which may
+ * overlap, and only then stored, which is correct for overlapping areas in
+ * either direction. Larger areas are copied by 64-byte blocks using LDP/STP
+ * with aligned stores, forwards or backwards depending on the overlap, with
+ * the unaligned head and tail loaded in advance and stored at the end.
+ * memset() follows the same size tiers, and zeroes large areas with DC ZVA
+ * when the CPU permits it with 64-byte blocks.
+ */
+__asm__ (
+".section .text.nolibc_memmove_memcpy\n"
+".weak memmove\n"
+".weak memcpy\n"
+"memmove:\n"
+"memcpy:\n"
+	"add  x4, x1, x2\n\t"
+	"add  x5, x0, x2\n\t"
+	"cmp  x2, #16\n\t"
+	"b.lo 6f\n\t"
+	"cmp  x2, #32\n\t"
+	"b.hi 1f\n\t"
+	"ldr  q0, [x1]\n\t"
+	"ldr  q1, [x4, #-16]\n\t"
+	"str  q0, [x0]\n\t"
+	"str  q1, [x5, #-16]\n\t"
+	"ret\n"
+"1:\n\t" /* 33 to 64 bytes */
+	"cmp  x2, #64\n\t"
+	"b.hi 2f\n\t"
+	"ldp  q0, q1, [x1]\n\t"
+	"ldp  q2, q3, [x4, #-32]\n\t"
+	"stp  q0, q1, [x0]\n\t"
+	"stp  q2, q3, [x5, #-32]\n\t"
+	"ret\n"
+"2:\n\t" /* 65 to 128 bytes */
+	"cmp  x2, #128\n\t"
+	"b.hi 3f\n\t"
+	"ldp  q0, q1, [x1]\n\t"
+	"ldp  q2, q3, [x1, #32]\n\t"
+	"ldp  q4, q5, [x4, #-64]\n\t"
+	"ldp  q6, q7, [x4, #-32]\n\t"
+	"stp  q0, q1, [x0]\n\t"
+	"stp  q2, q3, [x0, #32]\n\t"
+	"stp  q4, q5, [x5, #-64]\n\t"
+	"stp  q6, q7, [x5, #-32]\n\t"
+	"ret\n"
+"3:\n\t" /* more than 128 bytes */
+	"ldp  q16, q17, [x1]\n\t"
+	"ldp  q18, q19, [x1, #32]\n\t"
+	"ldp  q20, q21, [x4, #-64]\n\t"
+	"ldp  q22, q23, [x4, #-32]\n\t"
+	"sub  x3, x0, x1\n\t"
+	"cmp  x3, x2\n\t"
+	"b.lo 5f\n\t"
+	"and  x3, x0, #15\n\t"
+	"mov  x6, #16\n\t"
+	"sub  x3, x6, x3\n\t"
+	"add  x6, x0, x3\n\t"
+	"add  x7, x1, x3\n\t"
+	"sub  x8, x5, #64\n"
+"4:\n\t"
+	"ldp  q0, q1, [x7]\n\t"
+	"ldp  q2, q3, [x7, #32]\n\t"
+	"stp  q0, q1, [x6]\n\t"
+	"stp  q2, q3, [x6, #32]\n\t"
+	"add  x7, x7, #64\n\t"
+	"add  x6, x6, #64\n\t"
+	"cmp  x6, x8\n\t"
+	"b.lo 4b\n\t"
+	"str  q16, [x0]\n\t"
+	"stp  q20, q21, [x5, #-64]\n\t"
+	"stp  q22, q23, [x5, #-32]\n\t"
+	"ret\n"
+"5:\n\t" /* backward copy, from the aligned end of the destination */
+	"and  x3, x5, #15\n\t"
+	"sub  x6, x5, x3\n\t"
+	"sub  x7, x4, x3\n\t"
+	"add  x8, x0, #64\n"
+"51:\n\t"
+	"ldp  q2, q3, [x7, #-32]\n\t"
+	"ldp  q0, q1, [x7, #-64]\n\t"
+	"stp  q2, q3, [x6, #-32]\n\t"
+	"stp  q0, q1, [x6, #-64]\n\t"
+	"sub  x7, x7, #64\n\t"
+	"sub  x6, x6, #64\n\t"
+	"cmp  x6, x8\n\t"
+	"b.hi 51b\n\t"
+	"stp  q22, q23, [x5, #-32]\n\t"
+	"stp  q16, q17, [x0]\n\t"
+	"stp  q18, q19, [x0, #32]\n\t"
+	"ret\n"
+"6:\n\t" /* less than 16 bytes */
+	"cmp  x2, #8\n\t"
+	"b.lo 7f\n\t"
+	"ldr  x6, [x1]\n\t"
+	"ldr  x7, [x4, #-8]\n\t"
+	"str  x6, [x0]\n\t"
+	"str  x7, [x5, #-8]\n\t"
+	"ret\n"
+"7:\n\t"
+	"cmp  x2, #4\n\t"
+	"b.lo 8f\n\t"
+	"ldr  w6, [x1]\n\t"
+	"ldr  w7, [x4, #-4]\n\t"
+	"str  w6, [x0]\n\t"
+	"str  w7, [x5, #-4]\n\t"
+	"ret\n"
+"8:\n\t"
+	"cbz  x2, 9f\n\t"
+	"lsr  x3, x2, #1\n\t"
+	"ldrb w6, [x1]\n\t"
+	"ldrb w7, [x4, #-1]\n\t"
+	"ldrb w8, [x1, x3]\n\t"
+	"strb w6, [x0]\n\t"
+	"strb w8, [x0, x3]\n\t"
+	"strb w7, [x5, #-1]\n"
+"9:\n\t"
+	"ret\n"
+
+".section .text.nolibc_memset\n"
+".weak memset\n"
+"memset:\n"
+	"dup  v0.16b, w1\n\t"
+	"add  x5, x0, x2\n\t"
+	"cmp  x2, #16\n\t"
+	"b.lo 6f\n\t"
+	"str  q0, [x0]\n\t"
+	"str  q0, [x5, #-16]\n\t"
+	"cmp  x2, #32\n\t"
+	"b.ls 9f\n\t"
+	"str  q0, [x0, #16]\n\t"
+	"str  q0, [x5, #-32]\n\t"
+	"cmp  x2, #64\n\t"
+	"b.ls 9f\n\t"
+	"stp  q0, q0, [x0, #32]\n\t"
+	"stp  q0, q0, [x5, #-64]\n\t"
+	"cmp  x2, #128\n\t"
+	"b.ls 9f\n\t"
+	/* the first and last 64 bytes are set, fill the middle */
+	"tst  w1, #255\n\t"
+	"b.ne 2f\n\t"
+	"cmp  x2, #256\n\t"
+	"b.lo 2f\n\t"
+	"mrs  x3, dczid_el0\n\t"
+	"and  w3, w3, #31\n\t"
+	"cmp  w3, #4\n\t"   /* allowed, and 64-byte blocks */
+	"b.ne 2f\n\t"
+	"add  x6, x0, #64\n\t"
+	"and  x6, x6, #-64\n\t"
+	"and  x8, x5, #-64\n"
+"1:\n\t"
+	"dc   zva, x6\n\t"
+	"add  x6, x6, #64\n\t"
+	"cmp  x6, x8\n\t"
+	"b.lo 1b\n\t"
+	"ret\n"
+"2:\n\t"
+	"add  x6, x0, #64\n\t"
+	"and  x6, x6, #-16\n\t"
+	"sub  x8, x5, #64\n"
+"3:\n\t"
+	"stp  q0, q0, [x6]\n\t"
+	"stp  q0, q0, [x6, #32]\n\t"
+	"add  x6, x6, #64\n\t"
+	"cmp  x6, x8\n\t"
+	"b.lo 3b\n\t"
+	"ret\n"
+"6:\n\t" /* less than 16 bytes */
+	"cmp  x2, #8\n\t"
+	"b.lo 7f\n\t"
+	"str  d0, [x0]\n\t"
+	"str  d0, [x5, #-8]\n\t"
+	"ret\n"
+"7:\n\t"
+	"cmp  x2, #4\n\t"
+	"b.lo 8f\n\t"
+	"str  s0, [x0]\n\t"
+	"str  s0, [x5, #-4]\n\t"
+	"ret\n"
+"8:\n\t"
+	"cbz  x2, 9f\n\t"
+	"strb w1, [x0]\n\t"
+	"cmp  x2, #2\n\t"
+	"b.lo 9f\n\t"
+	"str  h0, [x5, #-2]\n"
+"9:\n\t"
+	"ret\n"
+);
+
+/* The scanning functions below are only provided for little endian. memchr()
+ * and strlen() compare 16 bytes at once with NEON and read aligned blocks,
+ * which never cross a page boundary. Their comparison result is narrowed to 4
+ * bits per byte with SHRN to be tested in a general purpose register. memcmp()
+ * compares 16 bytes at once with LDP, the last block overlapping the previous
+ * one.
+ */
+#if !defined(__AARCH64EB__)
+#define NOLIBC_ARCH_HAS_MEMCHR
+void *memchr(const void *s, int c, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMCMP
+int memcmp(const void *s1, const void *s2, size_t n);
+
+#define NOLIBC_ARCH_HAS_STRLEN
+size_t strlen(const char *str);
+
+__asm__ (
+".section .text.nolibc_memchr\n"
+".weak memchr\n"
+"memchr:\n"
+	"cbz  x2, 9f\n\t"
+	"dup  v0.16b, w1\n\t"
+	"and  x3, x0, #15\n\t"
+	"bic  x4, x0, #15\n\t"
+	"ldr  q1, [x4]\n\t"
+	"cmeq v1.16b, v1.16b, v0.16b\n\t"
+	"shrn v1.8b, v1.8h, #4\n\t"
+	"fmov x5, d1\n\t"
+	"lsl  x6, x3, #2\n\t"
+	"lsr  x5, x5, x6\n\t"
+	"cbnz x5, 3f\n\t"
+	"mov  x6, #16\n\t"  /* x2 = bytes left after the first block */
+	"sub  x6, x6, x3\n\t"
+	"subs x2, x2, x6\n\t"
+	"b.ls 9f\n"
+"1:\n\t"
+	"ldr  q1, [x4, #16]!\n\t"
+	"cmeq v1.16b, v1.16b, v0.16b\n\t"
+	"shrn v1.8b, v1.8h, #4\n\t"
+	"fmov x5, d1\n\t"
+	"cbnz x5, 2f\n\t"
+	"subs x2, x2, #16\n\t"
+	"b.hi 1b\n\t"
+	"b    9f\n"
+"2:\n\t"
+	"mov  x0, x4\n"
+"3:\n\t" /* found at 1/4 of the position of the lowest bit in x5 from x0 */
+	"rbit x5, x5\n\t"
+	"clz  x5, x5\n\t"
+	"lsr  x5, x5, #2\n\t"
+	"cmp  x5, x2\n\t"
+	"b.hs 9f\n\t"
+	"add  x0, x0, x5\n\t"
+	"ret\n"
+"9:\n\t"
+	"mov  x0, #0\n\t"
+	"ret\n"
+
+".section .text.nolibc_memcmp\n"
+".weak memcmp\n"
+"memcmp:\n"
+	"add  x6, x0, x2\n\t"
+	"add  x7, x1, x2\n\t"
+	"cmp  x2, #16\n\t"
+	"b.lo 5f\n"
+"1:\n\t"
+	"ldp  x3, x4, [x0], #16\n\t"
+	"ldp  x5, x8, [x1], #16\n\t"
+	"cmp  x3, x5\n\t"
+	"b.ne 3f\n\t"
+	"cmp  x4, x8\n\t"
+	"b.ne 2f\n\t"
+	"sub  x2, x2, #16\n\t"
+	"cmp  x2, #16\n\t"
+	"b.hs 1b\n\t"
+	"cbz  x2, 4f\n\t"
+	"sub  x0, x6, #16\n\t"
+	"sub  x1, x7, #16\n\t"
+	"mov  x2, #16\n\t"
+	"b    1b\n"
+"2:\n\t"
+	"mov  x3, x4\n\t"
+	"mov  x5, x8\n"
+"3:\n\t" /* x3 and x5 differ, the first byte in memory is the lowest */
+	"rev  x3, x3\n\t"
+	"rev  x5, x5\n\t"
+	"cmp  x3, x5\n\t"
+	"mov  w0, #1\n\t"
+	"cneg w0, w0, lo\n\t"
+	"ret\n"
+"4:\n\t"
+	"mov  w0, #0\n\t"
+	"ret\n"
+"5:\n\t" /* less than 16 bytes */
+	"cmp  x2, #8\n\t"
+	"b.lo 6f\n\t"
+	"ldr  x3, [x0]\n\t"
+	"ldr  x5, [x1]\n\t"
+	"cmp  x3, x5\n\t"
+	"b.ne 3b\n\t"
+	"ldr  x3, [x6, #-8]\n\t"
+	"ldr  x5, [x7, #-8]\n\t"
+	"cmp  x3, x5\n\t"
+	"b.ne 3b\n\t"
+	"b    4b\n"
+"6:\n\t"
+	"cmp  x2, #4\n\t"
+	"b.lo 7f\n\t"
+	"ldr  w3, [x0]\n\t"
+	"ldr  w5, [x1]\n\t"
+	"cmp  x3, x5\n\t"
+	"b.ne 3b\n\t"
+	"ldr  w3, [x6, #-4]\n\t"
+	"ldr  w5, [x7, #-4]\n\t"
+	"cmp  x3, x5\n\t"
+	"b.ne 3b\n\t"
+	"b    4b\n"
+"7:\n\t"
+	"cbz  x2, 4b\n"
+"71:\n\t"
+	"ldrb w3, [x0], #1\n\t"
+	"ldrb w5, [x1], #1\n\t"
+	"subs w4, w3, w5\n\t"
+	"b.ne 72f\n\t"
+	"subs x2, x2, #1\n\t"
+	"b.ne 71b\n"
+"72:\n\t"
+	"mov  w0, w4\n\t"
+	"ret\n"
+
+".section .text.nolibc_strlen\n"
+".weak strlen\n"
+"strlen:\n"
+	"and  x3, x0, #15\n\t"
+	"bic  x4, x0, #15\n\t"
+	"ldr  q1, [x4]\n\t"
+	"cmeq v1.16b, v1.16b, #0\n\t"
+	"shrn v1.8b, v1.8h, #4\n\t"
+	"fmov x5, d1\n\t"
+	"lsl  x6, x3, #2\n\t"
+	"lsr  x5, x5, x6\n\t"
+	"cbnz x5, 2f\n"
+"1:\n\t"
+	"ldr  q1, [x4, #16]!\n\t"
+	"cmeq v1.16b, v1.16b, #0\n\t"
+	"shrn v1.8b, v1.8h, #4\n\t"
+	"fmov x5, d1\n\t"
+	"cbz  x5, 1b\n\t"
+	"sub  x0, x4, x0\n\t"
+	"rbit x5, x5\n\t"
+	"clz  x5, x5\n\t"
+	"add  x0, x0, x5, lsr #2\n\t"
+	"ret\n"
+"2:\n\t"
+	"rbit x5, x5\n\t"
+	"clz  x5, x5\n\t"
+	"lsr  x0, x5, #2\n\t"
+	"ret\n"
+);
+#endif /* __AARCH64EB__ */
+
+/* CPU features reported by nolibc_cpu_has(). They are the AT_HWCAP bits,
+ * followed by the AT_HWCAP2 ones from 32. ASIMD is always present, which is
+ * why the string functions above have a single version.
+ */
+#define NOLIBC_CPU_FP         0
+#define NOLIBC_CPU_ASIMD      1
+#define NOLIBC_CPU_AES        3
+#define NOLIBC_CPU_PMULL      4
+#define NOLIBC_CPU_SHA1       5
+#define NOLIBC_CPU_SHA2       6
+#define NOLIBC_CPU_CRC32      7
+#define NOLIBC_CPU_ATOMICS    8
+#define NOLIBC_CPU_SHA3       17
+#define NOLIBC_CPU_SHA512     21
+#define NOLIBC_CPU_SVE        22
+#define NOLIBC_CPU_SVE2       (32 + 1)
+
+#define NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	return (getauxval(AT_HWCAP) & 0xffffffffULL) |
+	       (unsigned long long)getauxval(AT_HWCAP2) << 32;
+}
+
 #endif /* _NOLIBC_ARCH_AARCH64_H */
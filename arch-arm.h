@@ -28,6 +28,8 @@
 
 #include "compiler.h"
 #include "crt.h"
+#include "sys/auxv.h"
+#include <linux/auxvec.h>
 
 /* Syscalls for ARM in ARM or Thumb modes :
  *   - registers are 32-bit
@@ -213,4 +215,224 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	__nolibc_entrypoint_epilogue();
 }
 
+/* The memory functions below are provided for ARM and Thumb-2 when unaligned
+ * word accesses are supported (ARMv6 and above). Once the destination is
+ * aligned, data are moved by 32-byte bursts of LDM/STM, or of single LDR when
+ * the source is not aligned, since LDM requires an aligned address. The source
+ * is prefetched two bursts ahead with PLD. memmove() copies backwards with
+ * LDMDB/STMDB when the destination overlaps the end of the source. Symbols are
+ * typed as functions so that interworking works in Thumb mode.
+ */
+#if defined(__ARM_FEATURE_UNALIGNED) && (!defined(__thumb__) || defined(__thumb2__))
+#define NOLIBC_ARCH_HAS_MEMMOVE
+void *memmove(void *dst, const void *src, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMCPY
+void *memcpy(void *dst, const void *src, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMSET
+void *memset(void *dst, int c, size_t len);
+
+__asm__ (
+".section .text.nolibc_memmove_memcpy\n"
+".weak memmove\n"
+".weak memcpy\n"
+".type memmove, %function\n"
+".type memcpy, %function\n"
+"memmove:\n"
+	"sub   r3, r0, r1\n\t"
+	"cmp   r3, r2\n\t"
+	"blo   20f\n"
+"memcpy:\n"
+	"mov   r3, r0\n\t"
+	"cmp   r2, #8\n\t"
+	"blo   8f\n"
+"1:\n\t" /* align the destination */
+	"tst   r3, #3\n\t"
+	"beq   2f\n\t"
+	"ldrb  r12, [r1], #1\n\t"
+	"strb  r12, [r3], #1\n\t"
+	"sub   r2, r2, #1\n\t"
+	"b     1b\n"
+"2:\n\t"
+	"push  {r4-r9, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"blo   6f\n\t"
+	"tst   r1, #3\n\t"
+	"bne   4f\n"
+"3:\n\t"
+	"pld   [r1, #64]\n\t"
+	"ldmia r1!, {r4-r9, r12, lr}\n\t"
+	"stmia r3!, {r4-r9, r12, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"bhs   3b\n\t"
+	"b     6f\n"
+"4:\n\t" /* unaligned source */
+	"pld   [r1, #64]\n\t"
+	"ldr   r4, [r1]\n\t"
+	"ldr   r5, [r1, #4]\n\t"
+	"ldr   r6, [r1, #8]\n\t"
+	"ldr   r7, [r1, #12]\n\t"
+	"ldr   r8, [r1, #16]\n\t"
+	"ldr   r9, [r1, #20]\n\t"
+	"ldr   r12, [r1, #24]\n\t"
+	"ldr   lr, [r1, #28]\n\t"
+	"add   r1, r1, #32\n\t"
+	"stmia r3!, {r4-r9, r12, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"bhs   4b\n"
+"6:\n\t" /* less than 32 bytes left */
+	"add   r2, r2, #32\n\t"
+	"pop   {r4-r9, lr}\n"
+"7:\n\t"
+	"subs  r2, r2, #4\n\t"
+	"blo   71f\n\t"
+	"ldr   r12, [r1], #4\n\t"
+	"str   r12, [r3], #4\n\t"
+	"b     7b\n"
+"71:\n\t"
+	"add   r2, r2, #4\n"
+"8:\n\t"
+	"subs  r2, r2, #1\n\t"
+	"blo   9f\n\t"
+	"ldrb  r12, [r1], #1\n\t"
+	"strb  r12, [r3], #1\n\t"
+	"b     8b\n"
+"9:\n\t"
+	"bx    lr\n"
+
+"20:\n\t" /* backward copy, from the end */
+	"add   r1, r1, r2\n\t"
+	"add   r3, r0, r2\n\t"
+	"cmp   r2, #8\n\t"
+	"blo   28f\n"
+"21:\n\t"
+	"tst   r3, #3\n\t"
+	"beq   22f\n\t"
+	"ldrb  r12, [r1, #-1]!\n\t"
+	"strb  r12, [r3, #-1]!\n\t"
+	"sub   r2, r2, #1\n\t"
+	"b     21b\n"
+"22:\n\t"
+	"push  {r4-r9, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"blo   26f\n\t"
+	"tst   r1, #3\n\t"
+	"bne   24f\n"
+"23:\n\t"
+	"pld   [r1, #-64]\n\t"
+	"ldmdb r1!, {r4-r9, r12, lr}\n\t"
+	"stmdb r3!, {r4-r9, r12, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"bhs   23b\n\t"
+	"b     26f\n"
+"24:\n\t"
+	"pld   [r1, #-64]\n\t"
+	"ldr   r4, [r1, #-32]\n\t"
+	"ldr   r5, [r1, #-28]\n\t"
+	"ldr   r6, [r1, #-24]\n\t"
+	"ldr   r7, [r1, #-20]\n\t"
+	"ldr   r8, [r1, #-16]\n\t"
+	"ldr   r9, [r1, #-12]\n\t"
+	"ldr   r12, [r1, #-8]\n\t"
+	"ldr   lr, [r1, #-4]\n\t"
+	"sub   r1, r1, #32\n\t"
+	"stmdb r3!, {r4-r9, r12, lr}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"bhs   24b\n"
+"26:\n\t"
+	"add   r2, r2, #32\n\t"
+	"pop   {r4-r9, lr}\n"
+"27:\n\t"
+	"subs  r2, r2, #4\n\t"
+	"blo   271f\n\t"
+	"ldr   r12, [r1, #-4]!\n\t"
+	"str   r12, [r3, #-4]!\n\t"
+	"b     27b\n"
+"271:\n\t"
+	"add   r2, r2, #4\n"
+"28:\n\t"
+	"subs  r2, r2, #1\n\t"
+	"blo   29f\n\t"
+	"ldrb  r12, [r1, #-1]!\n\t"
+	"strb  r12, [r3, #-1]!\n\t"
+	"b     28b\n"
+"29:\n\t"
+	"bx    lr\n"
+
+".section .text.nolibc_memset\n"
+".weak memset\n"
+".type memset, %function\n"
+"memset:\n"
+	"mov   r3, r0\n\t"
+	"and   r1, r1, #255\n\t"
+	"orr   r1, r1, r1, lsl #8\n\t"
+	"orr   r1, r1, r1, lsl #16\n\t"
+	"cmp   r2, #8\n\t"
+	"blo   8f\n"
+"1:\n\t"
+	"tst   r3, #3\n\t"
+	"beq   2f\n\t"
+	"strb  r1, [r3], #1\n\t"
+	"sub   r2, r2, #1\n\t"
+	"b     1b\n"
+"2:\n\t"
+	"push  {r4-r9}\n\t"
+	"mov   r4, r1\n\t"
+	"mov   r5, r1\n\t"
+	"mov   r6, r1\n\t"
+	"mov   r7, r1\n\t"
+	"mov   r8, r1\n\t"
+	"mov   r9, r1\n\t"
+	"mov   r12, r1\n\t"
+	"subs  r2, r2, #32\n\t"
+	"blo   4f\n"
+"3:\n\t"
+	"stmia r3!, {r1, r4-r9, r12}\n\t"
+	"subs  r2, r2, #32\n\t"
+	"bhs   3b\n"
+"4:\n\t"
+	"add   r2, r2, #32\n\t"
+	"pop   {r4-r9}\n"
+"7:\n\t"
+	"subs  r2, r2, #4\n\t"
+	"blo   71f\n\t"
+	"str   r1, [r3], #4\n\t"
+	"b     7b\n"
+"71:\n\t"
+	"add   r2, r2, #4\n"
+"8:\n\t"
+	"subs  r2, r2, #1\n\t"
+	"blo   9f\n\t"
+	"strb  r1, [r3], #1\n\t"
+	"b     8b\n"
+"9:\n\t"
+	"bx    lr\n"
+);
+#endif /* __ARM_FEATURE_UNALIGNED */
+
+/* CPU features reported by nolibc_cpu_has(). They are the AT_HWCAP bits,
+ * followed by the AT_HWCAP2 ones from 32.
+ */
+#define NOLIBC_CPU_VFP        6
+#define NOLIBC_CPU_EDSP       7
+#define NOLIBC_CPU_NEON       12
+#define NOLIBC_CPU_VFPV3      13
+#define NOLIBC_CPU_VFPV4      16
+#define NOLIBC_CPU_IDIVA      17
+#define NOLIBC_CPU_IDIVT      18
+#define NOLIBC_CPU_LPAE       20
+#define NOLIBC_CPU_AES        (32 + 0)
+#define NOLIBC_CPU_PMULL      (32 + 1)
+#define NOLIBC_CPU_SHA1       (32 + 2)
+#define NOLIBC_CPU_SHA2       (32 + 3)
+#define NOLIBC_CPU_CRC32      (32 + 4)
+
+#define NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	return getauxval(AT_HWCAP) | (unsigned long long)getauxval(AT_HWCAP2) << 32;
+}
+
 #endif /* _NOLIBC_ARCH_ARM_H */
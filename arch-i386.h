@@ -194,4 +194,7 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	__nolibc_entrypoint_epilogue();
 }
 
+/* unaligned word accesses are about as fast as aligned ones */
+#define NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+
 #endif /* _NOLIBC_ARCH_I386_H */
@@ -9,6 +9,8 @@
 
 #include "compiler.h"
 #include "crt.h"
+#include "sys/auxv.h"
+#include <linux/auxvec.h>
 
 /* Syscalls for PowerPC :
  *   - stack is 16-byte aligned
@@ -216,4 +218,33 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	__nolibc_entrypoint_epilogue();
 }
 
+#ifdef __powerpc64__
+/* unaligned word accesses are about as fast as aligned ones */
+#define NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+#endif
+
+/* CPU features reported by nolibc_cpu_has(), numbered after the position of
+ * their PPC_FEATURE_* bit in AT_HWCAP, or in AT_HWCAP2 plus 32.
+ */
+#define NOLIBC_CPU_VSX        7
+#define NOLIBC_CPU_DFP        10
+#define NOLIBC_CPU_ALTIVEC    28
+#define NOLIBC_CPU_PPC64      30
+#define NOLIBC_CPU_MMA        (32 + 17)
+#define NOLIBC_CPU_ARCH_3_1   (32 + 18)
+#define NOLIBC_CPU_DARN       (32 + 21)
+#define NOLIBC_CPU_ARCH_3_00  (32 + 23)
+#define NOLIBC_CPU_VEC_CRYPTO (32 + 25)
+#define NOLIBC_CPU_ISEL       (32 + 27)
+#define NOLIBC_CPU_HTM        (32 + 30)
+#define NOLIBC_CPU_ARCH_2_07  (32 + 31)
+
+#define NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	return (getauxval(AT_HWCAP) & 0xffffffffULL) |
+	       (unsigned long long)getauxval(AT_HWCAP2) << 32;
+}
+
 #endif /* _NOLIBC_ARCH_POWERPC_H */
@@ -28,6 +28,9 @@
 
 #include "compiler.h"
 #include "crt.h"
+#include "sys/auxv.h"
+#include <linux/auxvec.h>
+#include <linux/unistd.h>
 
 /* Syscalls for RISCV :
  *   - stack is 16-byte aligned
@@ -172,4 +175,306 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	__nolibc_entrypoint_epilogue();
 }
 
+/* Some string functions have versions using the Zbb bit manipulation extension
+ * and the V vector extension, which __nolibc_cpu_bind() selects at startup when
+ * the CPU supports them. The V extension is reported in AT_HWCAP, but Zbb is
+ * only reported by the riscv_hwprobe syscall, or known at build time. Without
+ * them, the generic versions are used.
+ */
+#define NOLIBC_ARCH_DISPATCH_MEMCHR
+void *(*__nolibc_memchr_fn)(const void *s, int c, size_t len)
+	__attribute__((weak,unused,section(".data.nolibc_memchr_fn")));
+
+#define NOLIBC_ARCH_DISPATCH_MEMCPY
+void *(*__nolibc_memcpy_fn)(void *dst, const void *src, size_t len)
+	__attribute__((weak,unused,section(".data.nolibc_memcpy_fn")));
+
+#define NOLIBC_ARCH_DISPATCH_MEMSET
+void *(*__nolibc_memset_fn)(void *dst, int c, size_t len)
+	__attribute__((weak,unused,section(".data.nolibc_memset_fn")));
+
+#define NOLIBC_ARCH_DISPATCH_STRCMP
+int (*__nolibc_strcmp_fn)(const char *a, const char *b)
+	__attribute__((weak,unused,section(".data.nolibc_strcmp_fn")));
+
+#define NOLIBC_ARCH_DISPATCH_STRLEN
+size_t (*__nolibc_strlen_fn)(const char *str)
+	__attribute__((weak,unused,section(".data.nolibc_strlen_fn")));
+
+void *__nolibc_memchr_zbb(const void *s, int c, size_t len);
+int __nolibc_strcmp_zbb(const char *a, const char *b);
+size_t __nolibc_strlen_zbb(const char *str);
+void *__nolibc_memcpy_rvv(void *dst, const void *src, size_t len);
+void *__nolibc_memset_rvv(void *dst, int c, size_t len);
+size_t __nolibc_strlen_rvv(const char *str);
+
+#if __riscv_xlen == 64
+#define __NOLIBC_RISCV_SZ     "8"
+#define __NOLIBC_RISCV_LOAD   "ld"
+#else
+#define __NOLIBC_RISCV_SZ     "4"
+#define __NOLIBC_RISCV_LOAD   "lw"
+#endif
+
+/* Zbb versions. ORC.B turns each non-zero byte of a word into 0xff and each
+ * zero byte into 0x00, so that a word contains a zero byte when the result is
+ * not all ones, and CTZ on its complement gives the position of the first one.
+ * Only aligned words are loaded, which never cross a page boundary. strlen()
+ * forces the bytes located before the string to 0xff in its first word.
+ * strcmp() compares words once both strings are aligned, which requires them
+ * to have the same alignment, and otherwise compares bytes.
+ */
+__asm__ (
+".option push\n"
+".option arch, +zbb\n"
+".section .text.nolibc_memchr_zbb\n"
+".weak __nolibc_memchr_zbb\n"
+"__nolibc_memchr_zbb:\n\t"
+	"beqz  a2, 9f\n\t"
+	"andi  a1, a1, 0xff\n"
+"1:\n\t" /* bytes until <s> is aligned */
+	"andi  t0, a0, " __NOLIBC_RISCV_SZ "-1\n\t"
+	"beqz  t0, 2f\n\t"
+	"lbu   t2, 0(a0)\n\t"
+	"beq   t2, a1, 8f\n\t"
+	"addi  a0, a0, 1\n\t"
+	"addi  a2, a2, -1\n\t"
+	"bnez  a2, 1b\n\t"
+	"j     9f\n"
+"2:\n\t" /* t1 = <c> repeated in a word */
+	"slli  t1, a1, 8\n\t"
+	"or    t1, t1, a1\n\t"
+	"slli  t2, t1, 16\n\t"
+	"or    t1, t1, t2\n\t"
+#if __riscv_xlen == 64
+	"slli  t2, t1, 32\n\t"
+	"or    t1, t1, t2\n\t"
+#endif
+	"li    t3, -1\n\t"
+	"li    t4, " __NOLIBC_RISCV_SZ "\n"
+"3:\n\t"
+	"bltu  a2, t4, 4f\n\t"
+	__NOLIBC_RISCV_LOAD "    t2, 0(a0)\n\t"
+	"xor   t2, t2, t1\n\t"
+	"orc.b t2, t2\n\t"
+	"bne   t2, t3, 5f\n\t"
+	"addi  a0, a0, " __NOLIBC_RISCV_SZ "\n\t"
+	"addi  a2, a2, -" __NOLIBC_RISCV_SZ "\n\t"
+	"j     3b\n"
+"4:\n\t" /* less than a word left, ignore matches past the end */
+	"beqz  a2, 9f\n\t"
+	__NOLIBC_RISCV_LOAD "    t2, 0(a0)\n\t"
+	"xor   t2, t2, t1\n\t"
+	"orc.b t2, t2\n"
+"5:\n\t"
+	"not   t2, t2\n\t"
+	"ctz   t2, t2\n\t"
+	"srli  t2, t2, 3\n\t"
+	"bgeu  t2, a2, 9f\n\t"
+	"add   a0, a0, t2\n"
+"8:\n\t"
+	"ret\n"
+"9:\n\t"
+	"li    a0, 0\n\t"
+	"ret\n"
+
+".section .text.nolibc_strcmp_zbb\n"
+".weak __nolibc_strcmp_zbb\n"
+"__nolibc_strcmp_zbb:\n\t"
+	"xor   t0, a0, a1\n\t"
+	"andi  t0, t0, " __NOLIBC_RISCV_SZ "-1\n\t"
+	"bnez  t0, 3f\n"
+"1:\n\t" /* same alignment: bytes until aligned */
+	"andi  t0, a0, " __NOLIBC_RISCV_SZ "-1\n\t"
+	"beqz  t0, 2f\n\t"
+	"lbu   a2, 0(a0)\n\t"
+	"lbu   a3, 0(a1)\n\t"
+	"addi  a0, a0, 1\n\t"
+	"addi  a1, a1, 1\n\t"
+	"bne   a2, a3, 4f\n\t"
+	"bnez  a2, 1b\n\t"
+	"j     4f\n"
+"2:\n\t"
+	"li    t1, -1\n"
+"5:\n\t"
+	__NOLIBC_RISCV_LOAD "    a2, 0(a0)\n\t"
+	__NOLIBC_RISCV_LOAD "    a3, 0(a1)\n\t"
+	"orc.b t0, a2\n\t"
+	"bne   t0, t1, 6f\n\t"
+	"bne   a2, a3, 6f\n\t"
+	"addi  a0, a0, " __NOLIBC_RISCV_SZ "\n\t"
+	"addi  a1, a1, " __NOLIBC_RISCV_SZ "\n\t"
+	"j     5b\n"
+"6:\n\t" /* first byte which differs or ends <a> */
+	"xor   t2, a2, a3\n\t"
+	"orc.b t2, t2\n\t"
+	"orn   t2, t2, t0\n\t"
+	"ctz   t2, t2\n\t"
+	"srl   a2, a2, t2\n\t"
+	"srl   a3, a3, t2\n\t"
+	"andi  a2, a2, 0xff\n\t"
+	"andi  a3, a3, 0xff\n\t"
+	"sub   a0, a2, a3\n\t"
+	"ret\n"
+"3:\n\t" /* different alignments: bytes only */
+	"lbu   a2, 0(a0)\n\t"
+	"lbu   a3, 0(a1)\n\t"
+	"addi  a0, a0, 1\n\t"
+	"addi  a1, a1, 1\n\t"
+	"bne   a2, a3, 4f\n\t"
+	"bnez  a2, 3b\n"
+"4:\n\t"
+	"sub   a0, a2, a3\n\t"
+	"ret\n"
+
+".section .text.nolibc_strlen_zbb\n"
+".weak __nolibc_strlen_zbb\n"
+"__nolibc_strlen_zbb:\n\t"
+	"andi  t0, a0, " __NOLIBC_RISCV_SZ "-1\n\t"
+	"sub   a1, a0, t0\n\t"
+	__NOLIBC_RISCV_LOAD "    a2, 0(a1)\n\t"
+	"orc.b a2, a2\n\t"
+	"slli  t0, t0, 3\n\t"
+	"li    t1, -1\n\t"
+	"sll   t2, t1, t0\n\t"
+	"orn   a2, a2, t2\n\t"
+	"bne   a2, t1, 2f\n"
+"1:\n\t"
+	"addi  a1, a1, " __NOLIBC_RISCV_SZ "\n\t"
+	__NOLIBC_RISCV_LOAD "    a2, 0(a1)\n\t"
+	"orc.b a2, a2\n\t"
+	"beq   a2, t1, 1b\n"
+"2:\n\t"
+	"not   a2, a2\n\t"
+	"ctz   a2, a2\n\t"
+	"srli  a2, a2, 3\n\t"
+	"add   a1, a1, a2\n\t"
+	"sub   a0, a1, a0\n\t"
+	"ret\n"
+".option pop\n"
+);
+
+/* V versions. They process as many bytes per iteration as the vector unit
+ * permits with 8 registers grouped, VSETVLI returning the count. strlen() uses
+ * a fault-only-first load, which stops before an inaccessible page instead of
+ * faulting past the first byte.
+ */
+__asm__ (
+".option push\n"
+".option arch, +v\n"
+".section .text.nolibc_memcpy_rvv\n"
+".weak __nolibc_memcpy_rvv\n"
+"__nolibc_memcpy_rvv:\n\t"
+	"mv    a3, a0\n"
+"1:\n\t"
+	"vsetvli t0, a2, e8, m8, ta, ma\n\t"
+	"vle8.v  v8, (a1)\n\t"
+	"vse8.v  v8, (a3)\n\t"
+	"sub   a2, a2, t0\n\t"
+	"add   a1, a1, t0\n\t"
+	"add   a3, a3, t0\n\t"
+	"bnez  a2, 1b\n\t"
+	"ret\n"
+
+".section .text.nolibc_memset_rvv\n"
+".weak __nolibc_memset_rvv\n"
+"__nolibc_memset_rvv:\n\t"
+	"mv    a3, a0\n\t"
+	"vsetvli t0, zero, e8, m8, ta, ma\n\t"
+	"vmv.v.x v8, a1\n"
+"1:\n\t"
+	"vsetvli t0, a2, e8, m8, ta, ma\n\t"
+	"vse8.v  v8, (a3)\n\t"
+	"sub   a2, a2, t0\n\t"
+	"add   a3, a3, t0\n\t"
+	"bnez  a2, 1b\n\t"
+	"ret\n"
+
+".section .text.nolibc_strlen_rvv\n"
+".weak __nolibc_strlen_rvv\n"
+"__nolibc_strlen_rvv:\n\t"
+	"mv    a1, a0\n"
+"1:\n\t"
+	"vsetvli t0, zero, e8, m8, ta, ma\n\t"
+	"vle8ff.v v8, (a1)\n\t"
+	"csrr  t0, vl\n\t"
+	"vmseq.vi v0, v8, 0\n\t"
+	"vfirst.m t1, v0\n\t"
+	"add   a1, a1, t0\n\t"
+	"bltz  t1, 1b\n\t"
+	"sub   a1, a1, t0\n\t"
+	"add   a1, a1, t1\n\t"
+	"sub   a0, a1, a0\n\t"
+	"ret\n"
+".option pop\n"
+);
+
+/* CPU features reported by nolibc_cpu_has(). Single-letter extensions use the
+ * bit AT_HWCAP assigns them, others follow.
+ */
+#define NOLIBC_CPU_A      ('A' - 'A')
+#define NOLIBC_CPU_C      ('C' - 'A')
+#define NOLIBC_CPU_D      ('D' - 'A')
+#define NOLIBC_CPU_F      ('F' - 'A')
+#define NOLIBC_CPU_M      ('M' - 'A')
+#define NOLIBC_CPU_V      ('V' - 'A')
+#define NOLIBC_CPU_ZBB    32
+
+/* riscv_hwprobe() key and bit reporting Zbb */
+#define __NOLIBC_RISCV_HWPROBE_KEY_IMA_EXT_0   4
+#define __NOLIBC_RISCV_HWPROBE_EXT_ZBB         (1ULL << 4)
+
+/* returns non-zero if the CPU supports the Zbb extension */
+static __attribute__((unused))
+int __nolibc_riscv_has_zbb(void)
+{
+#if defined(__riscv_zbb)
+	return 1;
+#elif defined(__NR_riscv_hwprobe)
+	struct {
+		long long key;
+		unsigned long long value;
+	} pair = { __NOLIBC_RISCV_HWPROBE_KEY_IMA_EXT_0, 0 };
+
+	/* unknown keys are returned as -1 */
+	if (my_syscall5(__NR_riscv_hwprobe, &pair, 1, 0, 0, 0) < 0 || pair.key < 0)
+		return 0;
+	return !!(pair.value & __NOLIBC_RISCV_HWPROBE_EXT_ZBB);
+#else
+	return 0;
+#endif
+}
+
+#define NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	unsigned long long features;
+
+	features = getauxval(AT_HWCAP) & ((1UL << 26) - 1);
+#if defined(__riscv_vector)
+	features |= 1ULL << NOLIBC_CPU_V;
+#endif
+	if (__nolibc_riscv_has_zbb())
+		features |= 1ULL << NOLIBC_CPU_ZBB;
+	return features;
+}
+
+#define NOLIBC_ARCH_HAS_CPU_BIND
+static __attribute__((unused))
+void __nolibc_cpu_bind(unsigned long long features)
+{
+	if (features & (1ULL << NOLIBC_CPU_ZBB)) {
+		__nolibc_memchr_fn = __nolibc_memchr_zbb;
+		__nolibc_strcmp_fn = __nolibc_strcmp_zbb;
+		__nolibc_strlen_fn = __nolibc_strlen_zbb;
+	}
+
+	if (features & (1ULL << NOLIBC_CPU_V)) {
+		__nolibc_memcpy_fn = __nolibc_memcpy_rvv;
+		__nolibc_memset_fn = __nolibc_memset_rvv;
+		__nolibc_strlen_fn = __nolibc_strlen_rvv;
+	}
+}
+
 #endif /* _NOLIBC_ARCH_RISCV_H */
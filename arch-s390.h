@@ -189,4 +189,7 @@ pid_t sys_fork(void)
 }
 #define sys_fork sys_fork
 
+/* unaligned word accesses are about as fast as aligned ones */
+#define NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+
 #endif /* _NOLIBC_ARCH_S390_H */
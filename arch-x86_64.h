@@ -191,6 +191,9 @@ void __attribute__((weak, noreturn)) __nolibc_entrypoint __no_stack_protector _s
 	__nolibc_entrypoint_epilogue();
 }
 
+/* unaligned word accesses are about as fast as aligned ones */
+#define NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+
 #define NOLIBC_ARCH_HAS_MEMMOVE
 void *memmove(void *dst, const void *src, size_t len);
 
@@ -200,37 +203,695 @@ void *memcpy(void *dst, const void *src, size_t len);
 #define NOLIBC_ARCH_HAS_MEMSET
 void *memset(void *dst, int c, size_t len);
 
+#define NOLIBC_ARCH_HAS_MEMCHR
+void *memchr(const void *s, int c, size_t len);
+
+#define NOLIBC_ARCH_HAS_MEMCMP
+int memcmp(const void *s1, const void *s2, size_t n);
+
+#define NOLIBC_ARCH_HAS_STRCHR
+char *strchr(const char *s, int c);
+
+#define NOLIBC_ARCH_HAS_STRCMP
+int strcmp(const char *a, const char *b);
+
+#define NOLIBC_ARCH_HAS_STRLEN
+size_t strlen(const char *str);
+
+#define NOLIBC_ARCH_HAS_STRNLEN
+size_t strnlen(const char *str, size_t maxlen);
+
+/* size from which rep movsb and rep stosb are used. They are only fast on CPUs
+ * with ERMS, so __nolibc_cpu_bind() disables them on other ones.
+ */
+unsigned long __nolibc_x86_rep_min
+	__attribute__((weak,unused,section(".data.nolibc_x86_rep_min"))) = 2048;
+
+/* memmove() and memcpy() are the same function. Up to 256 bytes, the whole
+ * area is loaded into registers, using a first and a last block which may
+ * overlap, and only then stored, which is correct for overlapping areas in
+ * either direction. Larger forward copies use rep movsb from
+ * __nolibc_x86_rep_min bytes, and below that a loop of 64-byte blocks stored
+ * at aligned addresses, with the first 16 and last 64 bytes loaded in advance
+ * and stored at the end. Larger overlapping copies towards higher addresses
+ * run the same loop backwards, avoiding the slow std/rep movsb/cld sequence.
+ * memset() follows the same size tiers.
+ */
 __asm__ (
 ".section .text.nolibc_memmove_memcpy\n"
 ".weak memmove\n"
 ".weak memcpy\n"
 "memmove:\n"
 "memcpy:\n"
-	"movq %rdx, %rcx\n\t"
 	"movq %rdi, %rax\n\t"
-	"movq %rdi, %rdx\n\t"
-	"subq %rsi, %rdx\n\t"
-	"cmpq %rcx, %rdx\n\t"
-	"jb   1f\n\t"
-	"rep movsb\n\t"
+	"cmpq $16, %rdx\n\t"
+	"jb   6f\n\t"
+	"cmpq $32, %rdx\n\t"
+	"ja   1f\n\t"
+	"movdqu (%rsi), %xmm0\n\t"
+	"movdqu -16(%rsi, %rdx), %xmm1\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm1, -16(%rdi, %rdx)\n\t"
+	"retq\n"
+"1:\n\t" /* 33 to 64 bytes */
+	"cmpq $64, %rdx\n\t"
+	"ja   2f\n\t"
+	"movdqu (%rsi), %xmm0\n\t"
+	"movdqu 16(%rsi), %xmm1\n\t"
+	"movdqu -32(%rsi, %rdx), %xmm2\n\t"
+	"movdqu -16(%rsi, %rdx), %xmm3\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm1, 16(%rdi)\n\t"
+	"movdqu %xmm2, -32(%rdi, %rdx)\n\t"
+	"movdqu %xmm3, -16(%rdi, %rdx)\n\t"
+	"retq\n"
+"2:\n\t" /* 65 to 128 bytes */
+	"movdqu (%rsi), %xmm0\n\t"
+	"movdqu 16(%rsi), %xmm1\n\t"
+	"movdqu 32(%rsi), %xmm2\n\t"
+	"movdqu 48(%rsi), %xmm3\n\t"
+	"movdqu -64(%rsi, %rdx), %xmm4\n\t"
+	"movdqu -48(%rsi, %rdx), %xmm5\n\t"
+	"movdqu -32(%rsi, %rdx), %xmm6\n\t"
+	"movdqu -16(%rsi, %rdx), %xmm7\n\t"
+	"cmpq $128, %rdx\n\t"
+	"ja   3f\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm1, 16(%rdi)\n\t"
+	"movdqu %xmm2, 32(%rdi)\n\t"
+	"movdqu %xmm3, 48(%rdi)\n\t"
+	"movdqu %xmm4, -64(%rdi, %rdx)\n\t"
+	"movdqu %xmm5, -48(%rdi, %rdx)\n\t"
+	"movdqu %xmm6, -32(%rdi, %rdx)\n\t"
+	"movdqu %xmm7, -16(%rdi, %rdx)\n\t"
+	"retq\n"
+"3:\n\t" /* 129 to 256 bytes */
+	"cmpq $256, %rdx\n\t"
+	"ja   4f\n\t"
+	"movdqu 64(%rsi), %xmm8\n\t"
+	"movdqu 80(%rsi), %xmm9\n\t"
+	"movdqu 96(%rsi), %xmm10\n\t"
+	"movdqu 112(%rsi), %xmm11\n\t"
+	"movdqu -128(%rsi, %rdx), %xmm12\n\t"
+	"movdqu -112(%rsi, %rdx), %xmm13\n\t"
+	"movdqu -96(%rsi, %rdx), %xmm14\n\t"
+	"movdqu -80(%rsi, %rdx), %xmm15\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm1, 16(%rdi)\n\t"
+	"movdqu %xmm2, 32(%rdi)\n\t"
+	"movdqu %xmm3, 48(%rdi)\n\t"
+	"movdqu %xmm8, 64(%rdi)\n\t"
+	"movdqu %xmm9, 80(%rdi)\n\t"
+	"movdqu %xmm10, 96(%rdi)\n\t"
+	"movdqu %xmm11, 112(%rdi)\n\t"
+	"movdqu %xmm12, -128(%rdi, %rdx)\n\t"
+	"movdqu %xmm13, -112(%rdi, %rdx)\n\t"
+	"movdqu %xmm14, -96(%rdi, %rdx)\n\t"
+	"movdqu %xmm15, -80(%rdi, %rdx)\n\t"
+	"movdqu %xmm4, -64(%rdi, %rdx)\n\t"
+	"movdqu %xmm5, -48(%rdi, %rdx)\n\t"
+	"movdqu %xmm6, -32(%rdi, %rdx)\n\t"
+	"movdqu %xmm7, -16(%rdi, %rdx)\n\t"
+	"retq\n"
+"4:\n\t" /* more than 256 bytes, xmm0-3 hold the first 64, xmm4-7 the last 64 */
+	"movq %rdi, %rcx\n\t"
+	"subq %rsi, %rcx\n\t"
+	"cmpq %rdx, %rcx\n\t"
+	"jb   5f\n\t"
+	"cmpq __nolibc_x86_rep_min(%rip), %rdx\n\t"
+	"jae  9f\n\t"
+	"leaq (%rdi, %rdx), %r9\n\t"
+	"leaq -64(%rdi, %rdx), %r10\n\t"
+	"leaq 16(%rdi), %rcx\n\t"
+	"andq $-16, %rcx\n\t"
+	"subq %rdi, %rcx\n\t"
+	"addq %rcx, %rdi\n\t"
+	"addq %rcx, %rsi\n"
+"41:\n\t"
+	"movdqu (%rsi), %xmm8\n\t"
+	"movdqu 16(%rsi), %xmm9\n\t"
+	"movdqu 32(%rsi), %xmm10\n\t"
+	"movdqu 48(%rsi), %xmm11\n\t"
+	"movdqa %xmm8, (%rdi)\n\t"
+	"movdqa %xmm9, 16(%rdi)\n\t"
+	"movdqa %xmm10, 32(%rdi)\n\t"
+	"movdqa %xmm11, 48(%rdi)\n\t"
+	"addq $64, %rsi\n\t"
+	"addq $64, %rdi\n\t"
+	"cmpq %r10, %rdi\n\t"
+	"jb   41b\n\t"
+	"movdqu %xmm0, (%rax)\n\t"
+	"movdqu %xmm4, -64(%r9)\n\t"
+	"movdqu %xmm5, -48(%r9)\n\t"
+	"movdqu %xmm6, -32(%r9)\n\t"
+	"movdqu %xmm7, -16(%r9)\n\t"
 	"retq\n"
-"1:" /* backward copy */
-	"leaq -1(%rdi, %rcx, 1), %rdi\n\t"
-	"leaq -1(%rsi, %rcx, 1), %rsi\n\t"
-	"std\n\t"
-	"rep movsb\n\t"
-	"cld\n\t"
+"5:\n\t" /* backward copy, from the aligned end of the destination */
+	"leaq (%rdi, %rdx), %rcx\n\t"
+	"andq $-16, %rcx\n\t"
+	"movq %rcx, %r8\n\t"
+	"subq %rdi, %r8\n\t"
+	"addq %rsi, %r8\n\t"
+	"leaq 64(%rdi), %r10\n"
+"51:\n\t"
+	"movdqu -16(%r8), %xmm8\n\t"
+	"movdqu -32(%r8), %xmm9\n\t"
+	"movdqu -48(%r8), %xmm10\n\t"
+	"movdqu -64(%r8), %xmm11\n\t"
+	"movdqa %xmm8, -16(%rcx)\n\t"
+	"movdqa %xmm9, -32(%rcx)\n\t"
+	"movdqa %xmm10, -48(%rcx)\n\t"
+	"movdqa %xmm11, -64(%rcx)\n\t"
+	"subq $64, %r8\n\t"
+	"subq $64, %rcx\n\t"
+	"cmpq %r10, %rcx\n\t"
+	"ja   51b\n\t"
+	"movdqu %xmm7, -16(%rdi, %rdx)\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm1, 16(%rdi)\n\t"
+	"movdqu %xmm2, 32(%rdi)\n\t"
+	"movdqu %xmm3, 48(%rdi)\n\t"
+	"retq\n"
+"6:\n\t" /* less than 16 bytes */
+	"cmpl $8, %edx\n\t"
+	"jb   7f\n\t"
+	"movq (%rsi), %rcx\n\t"
+	"movq -8(%rsi, %rdx), %r8\n\t"
+	"movq %rcx, (%rdi)\n\t"
+	"movq %r8, -8(%rdi, %rdx)\n\t"
+	"retq\n"
+"7:\n\t"
+	"cmpl $4, %edx\n\t"
+	"jb   8f\n\t"
+	"movl (%rsi), %ecx\n\t"
+	"movl -4(%rsi, %rdx), %r8d\n\t"
+	"movl %ecx, (%rdi)\n\t"
+	"movl %r8d, -4(%rdi, %rdx)\n\t"
+	"retq\n"
+"8:\n\t"
+	"testl %edx, %edx\n\t"
+	"jz   10f\n\t"
+	"movzbl (%rsi), %ecx\n\t"
+	"movzbl -1(%rsi, %rdx), %r8d\n\t"
+	"cmpl $2, %edx\n\t"
+	"jbe  81f\n\t"
+	"movzbl 1(%rsi), %r9d\n\t"
+	"movb %r9b, 1(%rdi)\n"
+"81:\n\t"
+	"movb %cl, (%rdi)\n\t"
+	"movb %r8b, -1(%rdi, %rdx)\n\t"
+	"retq\n"
+"9:\n\t" /* large forward copy */
+	"movq %rdx, %rcx\n\t"
+	"rep movsb\n"
+"10:\n\t"
 	"retq\n"
 
 ".section .text.nolibc_memset\n"
 ".weak memset\n"
 "memset:\n"
-	"xchgl %eax, %esi\n\t"
-	"movq  %rdx, %rcx\n\t"
-	"pushq %rdi\n\t"
+	"movq %rdi, %rax\n\t"
+	"movzbl %sil, %ecx\n\t"
+	"movabsq $0x0101010101010101, %r8\n\t"
+	"imulq %r8, %rcx\n\t"
+	"cmpq $16, %rdx\n\t"
+	"jb   5f\n\t"
+	"movq %rcx, %xmm0\n\t"
+	"punpcklqdq %xmm0, %xmm0\n\t"
+	"movdqu %xmm0, (%rdi)\n\t"
+	"movdqu %xmm0, -16(%rdi, %rdx)\n\t"
+	"cmpq $32, %rdx\n\t"
+	"jbe  4f\n\t"
+	"movdqu %xmm0, 16(%rdi)\n\t"
+	"movdqu %xmm0, -32(%rdi, %rdx)\n\t"
+	"cmpq $64, %rdx\n\t"
+	"jbe  4f\n\t"
+	"movdqu %xmm0, 32(%rdi)\n\t"
+	"movdqu %xmm0, 48(%rdi)\n\t"
+	"movdqu %xmm0, -64(%rdi, %rdx)\n\t"
+	"movdqu %xmm0, -48(%rdi, %rdx)\n\t"
+	"cmpq $128, %rdx\n\t"
+	"jbe  4f\n\t"
+	"movq %rdi, %r9\n\t"
+	"cmpq __nolibc_x86_rep_min(%rip), %rdx\n\t"
+	"jae  3f\n\t"
+	/* the first and last 64 bytes are set, fill the middle aligned */
+	"leaq -64(%rdi, %rdx), %r10\n\t"
+	"leaq 64(%rdi), %rdi\n\t"
+	"andq $-16, %rdi\n"
+"2:\n\t"
+	"movdqa %xmm0, (%rdi)\n\t"
+	"movdqa %xmm0, 16(%rdi)\n\t"
+	"movdqa %xmm0, 32(%rdi)\n\t"
+	"movdqa %xmm0, 48(%rdi)\n\t"
+	"addq $64, %rdi\n\t"
+	"cmpq %r10, %rdi\n\t"
+	"jb   2b\n\t"
+	"retq\n"
+"3:\n\t" /* large area */
+	"movq %rdx, %rcx\n\t"
+	"movl %esi, %eax\n\t"
 	"rep stosb\n\t"
-	"popq  %rax\n\t"
+	"movq %r9, %rax\n"
+"4:\n\t"
+	"retq\n"
+"5:\n\t" /* less than 16 bytes */
+	"cmpl $8, %edx\n\t"
+	"jb   6f\n\t"
+	"movq %rcx, (%rdi)\n\t"
+	"movq %rcx, -8(%rdi, %rdx)\n\t"
+	"retq\n"
+"6:\n\t"
+	"cmpl $4, %edx\n\t"
+	"jb   7f\n\t"
+	"movl %ecx, (%rdi)\n\t"
+	"movl %ecx, -4(%rdi, %rdx)\n\t"
+	"retq\n"
+"7:\n\t"
+	"testl %edx, %edx\n\t"
+	"jz   8f\n\t"
+	"movb %cl, (%rdi)\n\t"
+	"cmpl $2, %edx\n\t"
+	"jb   8f\n\t"
+	"movw %cx, -2(%rdi, %rdx)\n"
+"8:\n\t"
 	"retq\n"
 );
 
+/* The scanning functions below compare a whole vector of bytes at once and
+ * turn the result into a bit mask with pmovmskb. They are built from a single
+ * template, once with 16-byte SSE2 vectors, which all x86_64 CPUs support, and
+ * once with 32-byte AVX2 ones, which __nolibc_cpu_bind() selects on CPUs
+ * supporting AVX2 by setting __nolibc_<name>_fn, that the SSE2 versions jump
+ * to when set. When the compiler already targets AVX2, only the AVX2 versions
+ * are built. _NOLIBC_VOP() emits a two-operand SSE instruction or its
+ * three-operand VEX form, and _NOLIBC_VBCST() repeats the low byte of a 32-bit
+ * register in a whole vector. Strings are read by aligned vectors, which never
+ * cross a page boundary, so that reading past their end is harmless.
+ */
+
+#define _NOLIBC_SCAN_FUNCS						\
+_NOLIBC_VENTRY("memchr")						\
+	"testq %rdx, %rdx\n\t"						\
+	"jz    3f\n\t"							\
+	_NOLIBC_VBCST("%esi", 1)					\
+	"movq  %rdi, %r8\n\t"						\
+	"movl  %edi, %ecx\n\t"						\
+	"andl  $" _NOLIBC_VLEN "-1, %ecx\n\t"				\
+	"andq  $-" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(0))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(0))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(0), "%eax")			\
+	"shrl  %cl, %eax\n\t"						\
+	"testl %eax, %eax\n\t"						\
+	"jnz   4f\n\t"							\
+	"subq  $" _NOLIBC_VLEN ", %rcx\n\t" /* rdx = bytes left after the first vector */ \
+	"addq  %rcx, %rdx\n\t"						\
+	"jnc   3f\n\t"							\
+	"jz    3f\n"							\
+"1:\n\t"								\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(0))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(0))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(0), "%eax")			\
+	"testl %eax, %eax\n\t"						\
+	"jnz   2f\n\t"							\
+	"subq  $" _NOLIBC_VLEN ", %rdx\n\t"				\
+	"ja    1b\n\t"							\
+	"jmp   3f\n"							\
+"2:\n\t"								\
+	"bsfl  %eax, %eax\n\t"						\
+	"cmpq  %rdx, %rax\n\t"						\
+	"jae   3f\n\t"							\
+	"addq  %rdi, %rax\n\t"						\
+	_NOLIBC_VRET							\
+"3:\n\t"								\
+	"xorl  %eax, %eax\n\t"						\
+	_NOLIBC_VRET							\
+"4:\n\t" /* found in the first vector, <eax> counts from <r8> */	\
+	"bsfl  %eax, %eax\n\t"						\
+	"cmpq  %rdx, %rax\n\t"						\
+	"jae   3b\n\t"							\
+	"addq  %r8, %rax\n\t"						\
+	_NOLIBC_VRET							\
+									\
+_NOLIBC_VENTRY("memcmp")						\
+	"cmpq  $" _NOLIBC_VLEN ", %rdx\n\t"				\
+	"jb    4f\n"							\
+"1:\n\t"								\
+	_NOLIBC_VMOV("movdqu", "(%rdi)", _NOLIBC_V(0))			\
+	_NOLIBC_VMOV("movdqu", "(%rsi)", _NOLIBC_V(1))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(0))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(0), "%eax")			\
+	"cmpl  $" _NOLIBC_VMASK ", %eax\n\t"				\
+	"jne   3f\n\t"							\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	"addq  $" _NOLIBC_VLEN ", %rsi\n\t"				\
+	"subq  $" _NOLIBC_VLEN ", %rdx\n\t"				\
+	"cmpq  $" _NOLIBC_VLEN ", %rdx\n\t"				\
+	"jae   1b\n\t"							\
+	"testq %rdx, %rdx\n\t"						\
+	"jz    2f\n\t"							\
+	/* compare the last vector, overlapping the previous one */	\
+	"leaq  -" _NOLIBC_VLEN "(%rdi, %rdx, 1), %rdi\n\t"		\
+	"leaq  -" _NOLIBC_VLEN "(%rsi, %rdx, 1), %rsi\n\t"		\
+	"movl  $" _NOLIBC_VLEN ", %edx\n\t"				\
+	"jmp   1b\n"							\
+"2:\n\t"								\
+	"xorl  %eax, %eax\n\t"						\
+	_NOLIBC_VRET							\
+"3:\n\t"								\
+	"notl  %eax\n\t"						\
+	"bsfl  %eax, %eax\n\t"						\
+	"movzbl (%rdi, %rax, 1), %ecx\n\t"				\
+	"movzbl (%rsi, %rax, 1), %edx\n\t"				\
+	"movl  %ecx, %eax\n\t"						\
+	"subl  %edx, %eax\n\t"						\
+	_NOLIBC_VRET							\
+"4:\n\t" /* too short for a vector */					\
+	"xorl  %eax, %eax\n\t"						\
+	"testq %rdx, %rdx\n\t"						\
+	"jz    6f\n"							\
+"5:\n\t"								\
+	"movzbl (%rdi), %eax\n\t"					\
+	"movzbl (%rsi), %ecx\n\t"					\
+	"subl  %ecx, %eax\n\t"						\
+	"jnz   6f\n\t"							\
+	"incq  %rdi\n\t"						\
+	"incq  %rsi\n\t"						\
+	"decq  %rdx\n\t"						\
+	"jnz   5b\n"							\
+"6:\n\t"								\
+	"retq\n"							\
+									\
+_NOLIBC_VENTRY("strchr")						\
+	_NOLIBC_VBCST("%esi", 1)					\
+	_NOLIBC_VOP("pxor", _NOLIBC_V(0), _NOLIBC_V(0))			\
+	"movl  %edi, %ecx\n\t"						\
+	"andl  $" _NOLIBC_VLEN "-1, %ecx\n\t"				\
+	"andq  $-" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(2))			\
+	_NOLIBC_VMOV("movdqa", _NOLIBC_V(2), _NOLIBC_V(3))		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(2))		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(3))		\
+	_NOLIBC_VOP("por", _NOLIBC_V(3), _NOLIBC_V(2))			\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(2), "%eax")			\
+	"shrl  %cl, %eax\n\t"						\
+	"addq  %rcx, %rdi\n\t"						\
+	"testl %eax, %eax\n\t"						\
+	"jnz   2f\n\t"							\
+	"andq  $-" _NOLIBC_VLEN ", %rdi\n"				\
+"1:\n\t"								\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(2))			\
+	_NOLIBC_VMOV("movdqa", _NOLIBC_V(2), _NOLIBC_V(3))		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(2))		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(3))		\
+	_NOLIBC_VOP("por", _NOLIBC_V(3), _NOLIBC_V(2))			\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(2), "%eax")			\
+	"testl %eax, %eax\n\t"						\
+	"jz    1b\n"							\
+"2:\n\t" /* either <c> or the trailing zero */				\
+	"bsfl  %eax, %eax\n\t"						\
+	"addq  %rdi, %rax\n\t"						\
+	"cmpb  (%rax), %sil\n\t"					\
+	"je    3f\n\t"							\
+	"xorl  %eax, %eax\n"						\
+"3:\n\t"								\
+	_NOLIBC_VRET							\
+									\
+/* vectors are read unaligned from both strings, except when one of them would \
+ * cross a page boundary, where a single byte is compared instead.	\
+ */									\
+_NOLIBC_VENTRY("strcmp")						\
+	_NOLIBC_VOP("pxor", _NOLIBC_V(0), _NOLIBC_V(0))			\
+"1:\n\t"								\
+	"movl  %edi, %eax\n\t"						\
+	"andl  $4095, %eax\n\t"						\
+	"cmpl  $4096-" _NOLIBC_VLEN ", %eax\n\t"			\
+	"ja    3f\n\t"							\
+	"movl  %esi, %eax\n\t"						\
+	"andl  $4095, %eax\n\t"						\
+	"cmpl  $4096-" _NOLIBC_VLEN ", %eax\n\t"			\
+	"ja    3f\n\t"							\
+	_NOLIBC_VMOV("movdqu", "(%rdi)", _NOLIBC_V(1))			\
+	_NOLIBC_VMOV("movdqu", "(%rsi)", _NOLIBC_V(2))			\
+	/* bytes which differ or are zero in <a> become zero */		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(1), _NOLIBC_V(2))		\
+	_NOLIBC_VOP("pminub", _NOLIBC_V(1), _NOLIBC_V(2))		\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(2))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(2), "%eax")			\
+	"testl %eax, %eax\n\t"						\
+	"jnz   2f\n\t"							\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	"addq  $" _NOLIBC_VLEN ", %rsi\n\t"				\
+	"jmp   1b\n"							\
+"2:\n\t"								\
+	"bsfl  %eax, %eax\n\t"						\
+	"addq  %rax, %rdi\n\t"						\
+	"addq  %rax, %rsi\n"						\
+"3:\n\t"								\
+	"movzbl (%rdi), %eax\n\t"					\
+	"movzbl (%rsi), %ecx\n\t"					\
+	"subl  %ecx, %eax\n\t"						\
+	"jnz   4f\n\t"							\
+	"testl %ecx, %ecx\n\t"						\
+	"jz    4f\n\t"							\
+	"incq  %rdi\n\t"						\
+	"incq  %rsi\n\t"						\
+	"jmp   1b\n"							\
+"4:\n\t"								\
+	_NOLIBC_VRET							\
+									\
+_NOLIBC_VENTRY("strlen")						\
+	"movq  %rdi, %rax\n\t"						\
+	_NOLIBC_VOP("pxor", _NOLIBC_V(0), _NOLIBC_V(0))			\
+	"movl  %edi, %ecx\n\t"						\
+	"andl  $" _NOLIBC_VLEN "-1, %ecx\n\t"				\
+	"andq  $-" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(1))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(1))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(1), "%edx")			\
+	"shrl  %cl, %edx\n\t"						\
+	"testl %edx, %edx\n\t"						\
+	"jnz   2f\n"							\
+"1:\n\t"								\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(1))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(1))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(1), "%edx")			\
+	"testl %edx, %edx\n\t"						\
+	"jz    1b\n\t"							\
+	"bsfl  %edx, %edx\n\t"						\
+	"subq  %rax, %rdi\n\t"						\
+	"leaq  (%rdi, %rdx, 1), %rax\n\t"				\
+	_NOLIBC_VRET							\
+"2:\n\t"								\
+	"bsfl  %edx, %eax\n\t"						\
+	_NOLIBC_VRET							\
+									\
+_NOLIBC_VENTRY("strnlen")						\
+	"xorl  %eax, %eax\n\t"						\
+	"testq %rsi, %rsi\n\t"						\
+	"jz    4f\n\t"							\
+	_NOLIBC_VOP("pxor", _NOLIBC_V(0), _NOLIBC_V(0))			\
+	"movl  %edi, %ecx\n\t"						\
+	"andl  $" _NOLIBC_VLEN "-1, %ecx\n\t"				\
+	"andq  $-" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(1))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(1))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(1), "%edx")			\
+	"shrl  %cl, %edx\n\t"						\
+	"movl  $" _NOLIBC_VLEN ", %eax\n\t" /* rax = bytes checked so far */ \
+	"subq  %rcx, %rax\n\t"						\
+	"testl %edx, %edx\n\t"						\
+	"jz    2f\n\t"							\
+	"xorl  %eax, %eax\n"						\
+"1:\n\t" /* zero found <edx> bytes after the first <rax> ones */	\
+	"bsfl  %edx, %edx\n\t"						\
+	"addq  %rdx, %rax\n\t"						\
+	"jmp   3f\n"							\
+"2:\n\t"								\
+	"cmpq  %rsi, %rax\n\t"						\
+	"jae   3f\n\t"							\
+	"addq  $" _NOLIBC_VLEN ", %rdi\n\t"				\
+	_NOLIBC_VMOV("movdqa", "(%rdi)", _NOLIBC_V(1))			\
+	_NOLIBC_VOP("pcmpeqb", _NOLIBC_V(0), _NOLIBC_V(1))		\
+	_NOLIBC_VMOV("pmovmskb", _NOLIBC_V(1), "%edx")			\
+	"testl %edx, %edx\n\t"						\
+	"jnz   1b\n\t"							\
+	"addq  $" _NOLIBC_VLEN ", %rax\n\t"				\
+	"jmp   2b\n"							\
+"3:\n\t"								\
+	"cmpq  %rsi, %rax\n\t"						\
+	"cmovaq %rsi, %rax\n"						\
+"4:\n\t"								\
+	_NOLIBC_VRET
+
+#if !defined(__AVX2__)
+void *(*__nolibc_memchr_fn)(const void *s, int c, size_t len)
+	__attribute__((weak,unused,section(".data.nolibc_memchr_fn")));
+int (*__nolibc_memcmp_fn)(const void *s1, const void *s2, size_t n)
+	__attribute__((weak,unused,section(".data.nolibc_memcmp_fn")));
+char *(*__nolibc_strchr_fn)(const char *s, int c)
+	__attribute__((weak,unused,section(".data.nolibc_strchr_fn")));
+int (*__nolibc_strcmp_fn)(const char *a, const char *b)
+	__attribute__((weak,unused,section(".data.nolibc_strcmp_fn")));
+size_t (*__nolibc_strlen_fn)(const char *str)
+	__attribute__((weak,unused,section(".data.nolibc_strlen_fn")));
+size_t (*__nolibc_strnlen_fn)(const char *str, size_t maxlen)
+	__attribute__((weak,unused,section(".data.nolibc_strnlen_fn")));
+
+void *__nolibc_memchr_avx2(const void *s, int c, size_t len);
+int __nolibc_memcmp_avx2(const void *s1, const void *s2, size_t n);
+char *__nolibc_strchr_avx2(const char *s, int c);
+int __nolibc_strcmp_avx2(const char *a, const char *b);
+size_t __nolibc_strlen_avx2(const char *str);
+size_t __nolibc_strnlen_avx2(const char *str, size_t maxlen);
+
+#define _NOLIBC_VLEN                "16"
+#define _NOLIBC_VMASK               "0xffff"
+#define _NOLIBC_V(n)                "%xmm" #n
+#define _NOLIBC_VMOV(op, src, dst)  op " " src ", " dst "\n\t"
+#define _NOLIBC_VOP(op, src, dst)   op " " src ", " dst "\n\t"
+#define _NOLIBC_VBCST(reg, n)       "movd " reg ", %xmm" #n "\n\t"           \
+				    "punpcklbw %xmm" #n ", %xmm" #n "\n\t"    \
+				    "punpcklwd %xmm" #n ", %xmm" #n "\n\t"    \
+				    "pshufd $0, %xmm" #n ", %xmm" #n "\n\t"
+#define _NOLIBC_VRET                "retq\n"
+#define _NOLIBC_VENTRY(name)        ".section .text.nolibc_" name "\n"       \
+				    ".weak " name "\n"                       \
+				    name ":\n\t"                             \
+				    "movq  __nolibc_" name "_fn(%rip), %r11\n\t" \
+				    "testq %r11, %r11\n\t"                   \
+				    "jz    99f\n\t"                          \
+				    "jmpq  *%r11\n"                          \
+				    "99:\n\t"
+
+__asm__ (
+_NOLIBC_SCAN_FUNCS
+);
+
+#undef _NOLIBC_VLEN
+#undef _NOLIBC_VMASK
+#undef _NOLIBC_V
+#undef _NOLIBC_VMOV
+#undef _NOLIBC_VOP
+#undef _NOLIBC_VBCST
+#undef _NOLIBC_VRET
+#undef _NOLIBC_VENTRY
+#endif /* __AVX2__ */
+
+#define _NOLIBC_VLEN                "32"
+#define _NOLIBC_VMASK               "0xffffffff"
+#define _NOLIBC_V(n)                "%ymm" #n
+#define _NOLIBC_VMOV(op, src, dst)  "v" op " " src ", " dst "\n\t"
+#define _NOLIBC_VOP(op, src, dst)   "v" op " " src ", " dst ", " dst "\n\t"
+#define _NOLIBC_VBCST(reg, n)       "vmovd " reg ", %xmm" #n "\n\t"          \
+				    "vpbroadcastb %xmm" #n ", %ymm" #n "\n\t"
+#define _NOLIBC_VRET                "vzeroupper\n\t" "retq\n"
+#if defined(__AVX2__)
+#define _NOLIBC_VENTRY(name)        ".section .text.nolibc_" name "\n"       \
+				    ".weak " name "\n"                       \
+				    name ":\n\t"
+#else
+#define _NOLIBC_VENTRY(name)        ".section .text.nolibc_" name "_avx2\n"  \
+				    ".weak __nolibc_" name "_avx2\n"         \
+				    "__nolibc_" name "_avx2:\n\t"
+#endif
+
+__asm__ (
+_NOLIBC_SCAN_FUNCS
+);
+
+/* CPU features reported by nolibc_cpu_has() */
+#define NOLIBC_CPU_SSE3       0
+#define NOLIBC_CPU_SSSE3      1
+#define NOLIBC_CPU_SSE41      2
+#define NOLIBC_CPU_SSE42      3
+#define NOLIBC_CPU_POPCNT     4
+#define NOLIBC_CPU_AVX        5
+#define NOLIBC_CPU_AVX2       6
+#define NOLIBC_CPU_BMI1       7
+#define NOLIBC_CPU_BMI2       8
+#define NOLIBC_CPU_ERMS       9
+#define NOLIBC_CPU_FSRM       10
+#define NOLIBC_CPU_AVX512F    11
+#define NOLIBC_CPU_AVX512BW   12
+
+/* sets <features> bit <feature> if bit <bit> of <reg> is set */
+#define __NOLIBC_CPUID_BIT(features, reg, bit, feature)                       \
+	((features) |= (unsigned long long)(((reg) >> (bit)) & 1) << (feature))
+
+/* stores in <regs> the eax, ebx, ecx and edx values of CPUID leaf <leaf> */
+static __inline__ __attribute__((unused))
+void __nolibc_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+	__asm__ volatile ("cpuid"
+			  : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+			  : "a"(leaf), "c"(subleaf));
+}
+
+/* AVX features are only reported when XGETBV says that the kernel saves the
+ * YMM registers, and AVX512 ones when it also saves the opmask and ZMM ones.
+ */
+#define NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	unsigned long long features = 0;
+	unsigned int regs[4], max, ecx, xcr0 = 0, edx;
+
+	__nolibc_cpuid(0, 0, regs);
+	max = regs[0];
+
+	__nolibc_cpuid(1, 0, regs);
+	ecx = regs[2];
+	if (ecx & (1U << 27)) /* OSXSAVE */
+		__asm__ volatile ("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+
+	__NOLIBC_CPUID_BIT(features, ecx, 0, NOLIBC_CPU_SSE3);
+	__NOLIBC_CPUID_BIT(features, ecx, 9, NOLIBC_CPU_SSSE3);
+	__NOLIBC_CPUID_BIT(features, ecx, 19, NOLIBC_CPU_SSE41);
+	__NOLIBC_CPUID_BIT(features, ecx, 20, NOLIBC_CPU_SSE42);
+	__NOLIBC_CPUID_BIT(features, ecx, 23, NOLIBC_CPU_POPCNT);
+	if ((xcr0 & 0x06) == 0x06)
+		__NOLIBC_CPUID_BIT(features, ecx, 28, NOLIBC_CPU_AVX);
+
+	if (max < 7)
+		return features;
+
+	__nolibc_cpuid(7, 0, regs);
+	__NOLIBC_CPUID_BIT(features, regs[1], 3, NOLIBC_CPU_BMI1);
+	__NOLIBC_CPUID_BIT(features, regs[1], 8, NOLIBC_CPU_BMI2);
+	__NOLIBC_CPUID_BIT(features, regs[1], 9, NOLIBC_CPU_ERMS);
+	__NOLIBC_CPUID_BIT(features, regs[3], 4, NOLIBC_CPU_FSRM);
+	if ((xcr0 & 0x06) == 0x06)
+		__NOLIBC_CPUID_BIT(features, regs[1], 5, NOLIBC_CPU_AVX2);
+	if ((xcr0 & 0xe6) == 0xe6) {
+		__NOLIBC_CPUID_BIT(features, regs[1], 16, NOLIBC_CPU_AVX512F);
+		__NOLIBC_CPUID_BIT(features, regs[1], 30, NOLIBC_CPU_AVX512BW);
+	}
+	return features;
+}
+
+#define NOLIBC_ARCH_HAS_CPU_BIND
+static __attribute__((unused))
+void __nolibc_cpu_bind(unsigned long long features)
+{
+	if (!(features & (1ULL << NOLIBC_CPU_ERMS)))
+		__nolibc_x86_rep_min = ~0UL;
+
+#if !defined(__AVX2__)
+	if (features & (1ULL << NOLIBC_CPU_AVX2)) {
+		__nolibc_memchr_fn = __nolibc_memchr_avx2;
+		__nolibc_memcmp_fn = __nolibc_memcmp_avx2;
+		__nolibc_strchr_fn = __nolibc_strchr_avx2;
+		__nolibc_strcmp_fn = __nolibc_strcmp_avx2;
+		__nolibc_strlen_fn = __nolibc_strlen_avx2;
+		__nolibc_strnlen_fn = __nolibc_strnlen_avx2;
+	}
+#endif
+}
+
 #endif /* _NOLIBC_ARCH_X86_64_H */
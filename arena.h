@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: LGPL-2.1 OR MIT */
+/*
+ * Arena allocator for NOLIBC
+ */
+
+/* make sure to include all global symbols */
+#include "nolibc.h"
+
+#ifndef _NOLIBC_ARENA_H
+#define _NOLIBC_ARENA_H
+
+#include "std.h"
+#include "sys/mman.h"
+#include "stdlib.h"
+
+/* An arena hands out memory from large mmap()ed chunks by simply advancing a
+ * pointer, without any per-object header. Objects cannot be freed one at a
+ * time. Instead the arena may be rewound to a position previously returned by
+ * nolibc_arena_mark(), or reset to its initial state by nolibc_arena_reset(),
+ * which releases at once everything allocated since then, regardless of the
+ * number of objects. Chunks released this way are kept for later allocations
+ * until nolibc_arena_destroy() unmaps them all. The arena descriptor itself
+ * lives at the beginning of its first chunk. Memory returned by an arena is
+ * only zeroed the first time it is used.
+ */
+
+#ifndef NOLIBC_ARENA_CHUNK
+#define NOLIBC_ARENA_CHUNK 262144
+#endif
+
+struct nolibc_arena_chunk {
+	struct nolibc_arena_chunk	*prev;	/* previous chunk, or next spare one */
+	size_t				size;	/* size of the mapping */
+	char				data[] __attribute__((__aligned__));
+};
+
+struct nolibc_arena {
+	struct nolibc_arena_chunk	*chunk;	/* chunk being filled */
+	struct nolibc_arena_chunk	*spare;	/* released chunks */
+	char				*ptr;	/* first free byte in <chunk> */
+	size_t				chunk_size; /* default size of new chunks */
+};
+
+struct nolibc_arena_pos {
+	struct nolibc_arena_chunk	*chunk;
+	char				*ptr;
+};
+
+/* returns a chunk able to store <len> bytes aligned to <align>, either taken
+ * from the <spare> list or newly mapped with at least <size> bytes, or NULL
+ * if none can be allocated.
+ */
+static __attribute__((unused))
+struct nolibc_arena_chunk *__nolibc_arena_chunk(struct nolibc_arena_chunk **spare,
+						size_t len, size_t align, size_t size)
+{
+	struct nolibc_arena_chunk *chunk, **prev;
+
+	if (__builtin_expect(len > -NOLIBC_MALLOC_PAGE - sizeof(*chunk) - align, 0)) {
+		SET_ERRNO(ENOMEM);
+		return NULL;
+	}
+	len += sizeof(*chunk) + align - 1;
+
+	for (prev = spare; (chunk = *prev); prev = &chunk->prev) {
+		if (chunk->size >= len) {
+			*prev = chunk->prev;
+			return chunk;
+		}
+	}
+
+	if (len < size)
+		len = size;
+	len = (len + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	chunk = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+	if (__builtin_expect(chunk == MAP_FAILED, 0))
+		return NULL;
+
+	chunk->size = len;
+	return chunk;
+}
+
+/* Creates a new arena whose chunks will be <chunk_size> bytes large, or
+ * NOLIBC_ARENA_CHUNK bytes if <chunk_size> is zero. Returns NULL on failure.
+ */
+static __attribute__((unused))
+struct nolibc_arena *nolibc_arena_create(size_t chunk_size)
+{
+	struct nolibc_arena_chunk *chunk, *spare = NULL;
+	struct nolibc_arena *arena;
+
+	if (!chunk_size)
+		chunk_size = NOLIBC_ARENA_CHUNK;
+
+	chunk = __nolibc_arena_chunk(&spare, sizeof(*arena), 1, chunk_size);
+	if (!chunk)
+		return NULL;
+
+	chunk->prev = NULL;
+	arena = (struct nolibc_arena *)chunk->data;
+	arena->chunk = chunk;
+	arena->spare = NULL;
+	arena->ptr = (char *)(arena + 1);
+	arena->chunk_size = chunk_size;
+	return arena;
+}
+
+/* Returns <len> bytes from arena <arena>, aligned to <align> which must be a
+ * power of two, or NULL if no more memory is available.
+ */
+static __attribute__((unused))
+void *nolibc_arena_alloc_aligned(struct nolibc_arena *arena, size_t len, size_t align)
+{
+	struct nolibc_arena_chunk *chunk = arena->chunk;
+	char *end = (char *)chunk + chunk->size;
+	char *ret;
+
+	ret = (char *)(((unsigned long)arena->ptr + align - 1) & -align);
+	if (__builtin_expect(ret > end || len > (size_t)(end - ret), 0)) {
+		chunk = __nolibc_arena_chunk(&arena->spare, len, align, arena->chunk_size);
+		if (!chunk)
+			return NULL;
+
+		chunk->prev = arena->chunk;
+		arena->chunk = chunk;
+		ret = (char *)(((unsigned long)chunk->data + align - 1) & -align);
+	}
+	arena->ptr = ret + len;
+	return ret;
+}
+
+/* Returns <len> bytes from arena <arena> aligned like malloc() does, or NULL
+ * if no more memory is available.
+ */
+static __inline__ __attribute__((unused))
+void *nolibc_arena_alloc(struct nolibc_arena *arena, size_t len)
+{
+	return nolibc_arena_alloc_aligned(arena, len, __alignof__(struct nolibc_arena_chunk));
+}
+
+/* returns the current position of arena <arena>, for nolibc_arena_rewind() */
+static __inline__ __attribute__((unused))
+struct nolibc_arena_pos nolibc_arena_mark(const struct nolibc_arena *arena)
+{
+	struct nolibc_arena_pos pos;
+
+	pos.chunk = arena->chunk;
+	pos.ptr = arena->ptr;
+	return pos;
+}
+
+/* Releases everything allocated from arena <arena> since position <pos> was
+ * returned by nolibc_arena_mark(). Positions marked after <pos> become invalid.
+ */
+static __attribute__((unused))
+void nolibc_arena_rewind(struct nolibc_arena *arena, struct nolibc_arena_pos pos)
+{
+	struct nolibc_arena_chunk *chunk;
+
+	while (arena->chunk != pos.chunk) {
+		chunk = arena->chunk;
+		arena->chunk = chunk->prev;
+		chunk->prev = arena->spare;
+		arena->spare = chunk;
+	}
+	arena->ptr = pos.ptr;
+}
+
+/* releases everything allocated from arena <arena> */
+static __attribute__((unused))
+void nolibc_arena_reset(struct nolibc_arena *arena)
+{
+	struct nolibc_arena_pos pos;
+
+	pos.chunk = container_of((void *)arena, struct nolibc_arena_chunk, data);
+	pos.ptr = (char *)(arena + 1);
+	nolibc_arena_rewind(arena, pos);
+}
+
+/* unmaps all the memory of arena <arena>, including the arena itself */
+static __attribute__((unused))
+void nolibc_arena_destroy(struct nolibc_arena *arena)
+{
+	struct nolibc_arena_chunk *chunk, *prev;
+
+	nolibc_arena_reset(arena);
+	for (chunk = arena->spare; chunk; chunk = prev) {
+		prev = chunk->prev;
+		munmap(chunk, chunk->size);
+	}
+	chunk = arena->chunk;
+	munmap(chunk, chunk->size);
+}
+
+#endif /* _NOLIBC_ARENA_H */
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1 OR MIT */
+/*
+ * CPU feature detection for NOLIBC
+ */
+
+/* make sure to include all global symbols */
+#include "nolibc.h"
+
+#ifndef _NOLIBC_CPU_H
+#define _NOLIBC_CPU_H
+
+#include "arch.h"
+#include "crt.h"
+
+/* A single static binary may run on CPUs of various generations, so the
+ * features which are worth checking are detected at run time. Architectures
+ * which know how to detect them define NOLIBC_ARCH_HAS_CPU_FEATURES, their
+ * NOLIBC_CPU_* feature numbers from 0 to 63, and __nolibc_cpu_detect() which
+ * returns a mask of these features' bits. Those which have several versions
+ * of some string functions also define NOLIBC_ARCH_HAS_CPU_BIND and
+ * __nolibc_cpu_bind(), which binds them to the best ones for these features.
+ * Both are called once from _start_c() through __nolibc_cpu_init(), before any
+ * constructor.
+ */
+
+#ifndef NOLIBC_ARCH_HAS_CPU_FEATURES
+static __attribute__((unused))
+unsigned long long __nolibc_cpu_detect(void)
+{
+	return 0;
+}
+#endif
+
+/* detected features, only valid once __nolibc_cpu_known is set */
+unsigned long long __nolibc_cpu_features __attribute__((weak));
+int __nolibc_cpu_known __attribute__((weak));
+
+void __nolibc_cpu_init(void);
+__attribute__((weak,unused,section(".text.nolibc_cpu_init")))
+void __nolibc_cpu_init(void)
+{
+	__nolibc_cpu_features = __nolibc_cpu_detect();
+	__nolibc_cpu_known = 1;
+#ifdef NOLIBC_ARCH_HAS_CPU_BIND
+	__nolibc_cpu_bind(__nolibc_cpu_features);
+#endif
+}
+
+/* Returns non-zero if the CPU supports feature <feature>, which is one of the
+ * NOLIBC_CPU_* values of the current architecture. Features the architecture
+ * does not know how to detect are reported as missing.
+ */
+static __attribute__((unused))
+int nolibc_cpu_has(unsigned int feature)
+{
+	if (!__nolibc_cpu_known) {
+		__nolibc_cpu_features = __nolibc_cpu_detect();
+		__nolibc_cpu_known = 1;
+	}
+	return feature < 64 && (__nolibc_cpu_features >> feature) & 1;
+}
+
+#endif /* _NOLIBC_CPU_H */
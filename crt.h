@@ -15,6 +15,7 @@ const unsigned long *_auxv __attribute__((weak));
 void _start(void);
 static void __stack_chk_init(void);
 static void exit(int);
+void __nolibc_cpu_init(void) __attribute__((weak));
 
 extern void (*const __preinit_array_start[])(int, char **, char**) __attribute__((weak));
 extern void (*const __preinit_array_end[])(int, char **, char**) __attribute__((weak));
@@ -74,6 +75,10 @@ void _start_c(long *sp)
 		;
 	_auxv = auxv;
 
+	/* detect the CPU features and bind the functions using them */
+	if (__nolibc_cpu_init)
+		__nolibc_cpu_init();
+
 	for (ctor_func = __preinit_array_start; ctor_func < __preinit_array_end; ctor_func++)
 		(*ctor_func)(argc, argv, envp);
 	for (ctor_func = __init_array_start; ctor_func < __init_array_end; ctor_func++)
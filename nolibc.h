@@ -145,6 +145,11 @@
 #include "getopt.h"
 #include "poll.h"
 #include "math.h"
+#include "arena.h"
+#include "vm.h"
+#include "shm.h"
+#include "numaif.h"
+#include "cpu.h"
 
 /* Used by programs to avoid std includes */
 #define NOLIBC
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: LGPL-2.1 OR MIT */
+/*
+ * NUMA memory policy definitions for NOLIBC
+ */
+
+/* make sure to include all global symbols */
+#include "nolibc.h"
+
+#ifndef _NOLIBC_NUMAIF_H
+#define _NOLIBC_NUMAIF_H
+
+#include "std.h"
+#include "errno.h"
+#include "sys.h"
+#include "sys/mman.h"
+#include "stdlib.h"
+#include <linux/mempolicy.h>
+
+/* highest number of NUMA nodes supported by the allocation helpers */
+#ifndef NOLIBC_NUMA_NODES
+#define NOLIBC_NUMA_NODES 1024
+#endif
+
+/*
+ * long get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode,
+ *                    void *addr, unsigned int flags);
+ */
+
+static __attribute__((unused))
+long sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode,
+		       void *addr, unsigned int flags)
+{
+#ifdef __NR_get_mempolicy
+	return my_syscall5(__NR_get_mempolicy, mode, nodemask, maxnode, addr, flags);
+#else
+	return __nolibc_enosys(__func__, mode, nodemask, maxnode, addr, flags);
+#endif
+}
+
+static __attribute__((unused))
+long get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode,
+		   void *addr, unsigned int flags)
+{
+	return __sysret(sys_get_mempolicy(mode, nodemask, maxnode, addr, flags));
+}
+
+
+/*
+ * long mbind(void *addr, unsigned long len, int mode, const unsigned long *nodemask,
+ *            unsigned long maxnode, unsigned int flags);
+ */
+
+static __attribute__((unused))
+long sys_mbind(void *addr, unsigned long len, int mode, const unsigned long *nodemask,
+	       unsigned long maxnode, unsigned int flags)
+{
+#ifdef __NR_mbind
+	return my_syscall6(__NR_mbind, addr, len, mode, nodemask, maxnode, flags);
+#else
+	return __nolibc_enosys(__func__, addr, len, mode, nodemask, maxnode, flags);
+#endif
+}
+
+static __attribute__((unused))
+long mbind(void *addr, unsigned long len, int mode, const unsigned long *nodemask,
+	   unsigned long maxnode, unsigned int flags)
+{
+	return __sysret(sys_mbind(addr, len, mode, nodemask, maxnode, flags));
+}
+
+
+/*
+ * long move_pages(int pid, unsigned long count, void **pages, const int *nodes,
+ *                 int *status, int flags);
+ */
+
+static __attribute__((unused))
+long sys_move_pages(int pid, unsigned long count, void **pages, const int *nodes,
+		    int *status, int flags)
+{
+#ifdef __NR_move_pages
+	return my_syscall6(__NR_move_pages, pid, count, pages, nodes, status, flags);
+#else
+	return __nolibc_enosys(__func__, pid, count, pages, nodes, status, flags);
+#endif
+}
+
+static __attribute__((unused))
+long move_pages(int pid, unsigned long count, void **pages, const int *nodes,
+		int *status, int flags)
+{
+	return __sysret(sys_move_pages(pid, count, pages, nodes, status, flags));
+}
+
+
+/*
+ * long set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+ */
+
+static __attribute__((unused))
+long sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode)
+{
+#ifdef __NR_set_mempolicy
+	return my_syscall3(__NR_set_mempolicy, mode, nodemask, maxnode);
+#else
+	return __nolibc_enosys(__func__, mode, nodemask, maxnode);
+#endif
+}
+
+static __attribute__((unused))
+long set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode)
+{
+	return __sysret(sys_set_mempolicy(mode, nodemask, maxnode));
+}
+
+
+/* The helpers below return large blocks whose pages are placed according to a
+ * memory policy applied before they are first touched. Each block gets its own
+ * mapping whatever its size, and is released by free() like any other one.
+ * Kernels built without NUMA support ignore the placement.
+ */
+
+/* maps a large block of <len> bytes with policy <mode> over the <nodemask> of
+ * <maxnode> bits, or returns NULL with errno set.
+ */
+static __attribute__((unused))
+void *__nolibc_malloc_mbind(size_t len, int mode, const unsigned long *nodemask,
+			    unsigned long maxnode)
+{
+	struct nolibc_heap *heap;
+	size_t size;
+	long ret;
+
+	if (__builtin_expect(len > -NOLIBC_MALLOC_PAGE - sizeof(*heap), 0)) {
+		SET_ERRNO(ENOMEM);
+		return NULL;
+	}
+
+	size = (sizeof(*heap) + len + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	heap = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+	if (__builtin_expect(heap == MAP_FAILED, 0))
+		return NULL;
+
+	ret = sys_mbind(heap, size, mode, nodemask, maxnode, 0);
+	if (ret < 0 && ret != -ENOSYS) {
+		munmap(heap, size);
+		SET_ERRNO(-ret);
+		return NULL;
+	}
+
+	heap->len = size;
+#if defined(NOLIBC_MALLOC_STATS)
+	heap->req = len;
+#endif
+	__nolibc_malloc_lock();
+	__NOLIBC_MALLOC_STAT(mmap_calls++);
+	__NOLIBC_MALLOC_STAT(mapped += size);
+	__nolibc_malloc_count(heap->user_p, 1);
+	__nolibc_malloc_unlock();
+	return heap->user_p;
+}
+
+/* Returns a block of <len> bytes placed on NUMA node <node> when it has free
+ * memory, or NULL with errno set, EINVAL meaning that the node does not exist.
+ */
+static __attribute__((unused))
+void *nolibc_malloc_onnode(size_t len, int node)
+{
+	unsigned long mask[NOLIBC_NUMA_NODES / (8 * sizeof(long))];
+
+	if ((unsigned int)node >= NOLIBC_NUMA_NODES) {
+		SET_ERRNO(EINVAL);
+		return NULL;
+	}
+
+	memset(mask, 0, sizeof(mask));
+	mask[node / (8 * sizeof(long))] = 1UL << (node % (8 * sizeof(long)));
+	return __nolibc_malloc_mbind(len, MPOL_PREFERRED, mask, NOLIBC_NUMA_NODES + 1);
+}
+
+/* Returns a block of <len> bytes whose pages are spread over all the nodes the
+ * process may use, which suits tables shared by threads running on different
+ * nodes, or NULL with errno set.
+ */
+static __attribute__((unused))
+void *nolibc_malloc_interleaved(size_t len)
+{
+	unsigned long mask[NOLIBC_NUMA_NODES / (8 * sizeof(long))];
+
+	if (sys_get_mempolicy(NULL, mask, NOLIBC_NUMA_NODES + 1, NULL, MPOL_F_MEMS_ALLOWED) < 0)
+		return __nolibc_malloc_mbind(len, MPOL_DEFAULT, NULL, 0);
+	return __nolibc_malloc_mbind(len, MPOL_INTERLEAVE, mask, NOLIBC_NUMA_NODES + 1);
+}
+
+#endif /* _NOLIBC_NUMAIF_H */
@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: LGPL-2.1 OR MIT */
+/*
+ * Shared memory allocator for NOLIBC
+ */
+
+/* make sure to include all global symbols */
+#include "nolibc.h"
+
+#ifndef _NOLIBC_SHM_H
+#define _NOLIBC_SHM_H
+
+#include "std.h"
+#include "stdint.h"
+#include "errno.h"
+#include "sys.h"
+#include "sys/mman.h"
+#include "stdlib.h"
+#include <linux/memfd.h>
+
+/* A shared pool is a memfd_create() file mapped with MAP_SHARED, so that it
+ * may be used by all processes forked after its creation, or by any process
+ * it was passed to as a file descriptor, and attached with
+ * nolibc_shm_attach(). Since the pool may be mapped at different addresses in
+ * each process, objects are designated by their offset from the start of the
+ * pool, which nolibc_shm_ptr() converts to a local pointer. Offset 0 is never
+ * a valid object and reports failures.
+ *
+ * The pool starts with a struct nolibc_shm, followed by blocks of 32 bytes to
+ * NOLIBC_SHM_MAX bytes, all powers of two, carved from its top. Each block
+ * starts with a struct nolibc_shm_blk recording its class. Freed blocks are
+ * pushed to a list per class, and are only ever reused for that class. The
+ * lists' heads are updated with compare-and-swap and carry a generation
+ * number, so that any process may allocate and free objects concurrently
+ * without any lock. Offsets are 32-bit, which limits pools to 4GB.
+ *
+ * Only native word sized atomic operations are used, since 32-bit platforms
+ * may lack 64-bit ones. The heads are thus longs holding the offset, which is
+ * a multiple of 16, in their NOLIBC_SHM_OFF_MASK bits, and the generation in
+ * the other ones, leaving 36 bits to it on 64-bit platforms but only 4 bits on
+ * 32-bit ones. For the same reason, a pool may only be shared by processes
+ * with the same word size.
+ */
+
+#define NOLIBC_SHM_MAGIC        0x6e6f6c6962636d31ULL
+#define NOLIBC_SHM_CLASSES      24
+#define NOLIBC_SHM_MAX          (32UL << (NOLIBC_SHM_CLASSES - 1))
+#define NOLIBC_SHM_OFF_MASK     0xfffffff0UL
+
+struct nolibc_shm {
+	uint64_t	magic;		/* NOLIBC_SHM_MAGIC */
+	uint64_t	size;		/* size of the pool */
+	uint32_t	top;		/* offset of the first unused byte */
+	unsigned long	free[NOLIBC_SHM_CLASSES]; /* free blocks, generation + offset */
+} __attribute__((__aligned__(16)));
+
+struct nolibc_shm_blk {
+	uint32_t	cls;		/* block size is 32 << cls */
+	uint32_t	next;		/* next free block of this class */
+	char		user_p[] __attribute__((__aligned__(16)));
+};
+
+/* maps <size> bytes of shared memory file <fd>, returns NULL on failure */
+static __attribute__((unused))
+struct nolibc_shm *__nolibc_shm_map(int fd, size_t size)
+{
+	void *ret;
+
+	ret = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ret == MAP_FAILED)
+		return NULL;
+	return ret;
+}
+
+/* Creates a shared pool of <size> bytes named <name>, rounded up to the page
+ * size. If <fd> is not NULL, the pool's file descriptor is stored there so
+ * that it may be passed to other processes, otherwise it is closed. Returns
+ * the pool or NULL with errno set.
+ */
+static __attribute__((unused))
+struct nolibc_shm *nolibc_shm_create(const char *name, size_t size, int *fd)
+{
+	struct nolibc_shm *shm;
+	int mfd;
+
+	size = (size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	if ((uint64_t)size > 0xffffffffULL || size < sizeof(*shm)) {
+		SET_ERRNO(EINVAL);
+		return NULL;
+	}
+
+	mfd = memfd_create(name, MFD_CLOEXEC);
+	if (mfd < 0)
+		return NULL;
+
+	shm = NULL;
+	if (ftruncate(mfd, size) == 0)
+		shm = __nolibc_shm_map(mfd, size);
+
+	if (shm) {
+		shm->magic = NOLIBC_SHM_MAGIC;
+		shm->size = size;
+		shm->top = sizeof(*shm);
+	}
+
+	if (shm && fd)
+		*fd = mfd;
+	else
+		close(mfd);
+	return shm;
+}
+
+/* Maps the shared pool of file descriptor <fd>, which must have been created
+ * by nolibc_shm_create(). Returns the pool or NULL with errno set.
+ */
+static __attribute__((unused))
+struct nolibc_shm *nolibc_shm_attach(int fd)
+{
+	struct nolibc_shm *shm;
+	size_t size;
+
+	shm = __nolibc_shm_map(fd, NOLIBC_MALLOC_PAGE);
+	if (!shm)
+		return NULL;
+
+	size = shm->size;
+	if (shm->magic != NOLIBC_SHM_MAGIC) {
+		munmap(shm, NOLIBC_MALLOC_PAGE);
+		SET_ERRNO(EINVAL);
+		return NULL;
+	}
+	munmap(shm, NOLIBC_MALLOC_PAGE);
+	return __nolibc_shm_map(fd, size);
+}
+
+/* unmaps pool <shm> from the calling process */
+static __attribute__((unused))
+int nolibc_shm_detach(struct nolibc_shm *shm)
+{
+	return munmap(shm, shm->size);
+}
+
+/* converts offset <off> in pool <shm> to a local pointer, or NULL if zero */
+static __inline__ __attribute__((unused))
+void *nolibc_shm_ptr(const struct nolibc_shm *shm, uint32_t off)
+{
+	return off ? (char *)shm + off : NULL;
+}
+
+/* converts local pointer <ptr> into pool <shm> to an offset, or 0 if NULL */
+static __inline__ __attribute__((unused))
+uint32_t nolibc_shm_off(const struct nolibc_shm *shm, const void *ptr)
+{
+	return ptr ? (uint32_t)((const char *)ptr - (const char *)shm) : 0;
+}
+
+/* returns head <head> with offset <off> and the next generation */
+static __inline__ __attribute__((unused))
+unsigned long __nolibc_shm_head(unsigned long head, uint32_t off)
+{
+	/* the offset's bits set to ones carry the increment over them */
+	return (((head | NOLIBC_SHM_OFF_MASK) + 1) & ~NOLIBC_SHM_OFF_MASK) + off;
+}
+
+/* Allocates <len> bytes from pool <shm>. Returns the object's offset, or 0
+ * with errno set to ENOMEM if the pool is full.
+ */
+static __attribute__((unused))
+uint32_t nolibc_shm_alloc(struct nolibc_shm *shm, size_t len)
+{
+	struct nolibc_shm_blk *blk;
+	unsigned long head, next;
+	unsigned int cls;
+	uint32_t top;
+
+	for (cls = 0; cls < NOLIBC_SHM_CLASSES && (32UL << cls) - sizeof(*blk) < len; cls++)
+		;
+
+	if (cls == NOLIBC_SHM_CLASSES) {
+		SET_ERRNO(ENOMEM);
+		return 0;
+	}
+
+	/* the block may be reused by another process between the load of its
+	 * next pointer and the CAS, which then fails thanks to the generation.
+	 */
+	head = __atomic_load_n(&shm->free[cls], __ATOMIC_ACQUIRE);
+	while (head & NOLIBC_SHM_OFF_MASK) {
+		blk = (struct nolibc_shm_blk *)((char *)shm + (head & NOLIBC_SHM_OFF_MASK));
+		next = __nolibc_shm_head(head, __atomic_load_n(&blk->next, __ATOMIC_RELAXED));
+		if (__atomic_compare_exchange_n(&shm->free[cls], &head, next, 1,
+						__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			return (head & NOLIBC_SHM_OFF_MASK) + sizeof(*blk);
+	}
+
+	top = __atomic_load_n(&shm->top, __ATOMIC_RELAXED);
+	do {
+		if ((32UL << cls) > shm->size - top) {
+			SET_ERRNO(ENOMEM);
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&shm->top, &top, top + (32UL << cls), 1,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	blk = (struct nolibc_shm_blk *)((char *)shm + top);
+	blk->cls = cls;
+	return top + sizeof(*blk);
+}
+
+/* releases object of offset <off> into pool <shm>, which is ignored if zero */
+static __attribute__((unused))
+void nolibc_shm_free(struct nolibc_shm *shm, uint32_t off)
+{
+	struct nolibc_shm_blk *blk;
+	unsigned long head, next;
+
+	if (!off)
+		return;
+
+	off -= sizeof(*blk);
+	blk = (struct nolibc_shm_blk *)((char *)shm + off);
+	head = __atomic_load_n(&shm->free[blk->cls], __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&blk->next, head & NOLIBC_SHM_OFF_MASK, __ATOMIC_RELAXED);
+		next = __nolibc_shm_head(head, off);
+	} while (!__atomic_compare_exchange_n(&shm->free[blk->cls], &head, next, 1,
+					      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+#endif /* _NOLIBC_SHM_H */
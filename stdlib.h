@@ -36,17 +36,1114 @@
 #include "string.h"
 #include <linux/auxvec.h>
 
+/* The allocator serves small requests from size classes carved out of 4kB
+ * slab pages, themselves taken NOLIBC_MALLOC_CHUNK bytes at a time from
+ * mmap(). Each slab page starts with a struct nolibc_slab and keeps its own
+ * list of free objects, and slabs of a same class having free objects are
+ * linked together. Objects are placed against the end of the page so that
+ * those of a class multiple of a power of two are aligned to it. Empty slab
+ * pages are recycled for any class. Requests larger than
+ * NOLIBC_MALLOC_SMALL_MAX get their own mapping, which starts with a struct
+ * nolibc_heap, followed by the user area at the first offset satisfying the
+ * requested alignment. Areas aligned to more than a page start on the page
+ * following the header. In all cases the header is found at the start of the
+ * page containing the byte just before the user pointer, and its first word
+ * tells them apart: a large block's length is always a multiple of the page
+ * size while a slab's tag is always odd.
+ *
+ * When NOLIBC_MALLOC_BRK is defined, requests up to NOLIBC_MALLOC_BRK_MAX
+ * bytes are instead served from a contiguous heap grown with brk() by steps
+ * of NOLIBC_MALLOC_BRK_STEP bytes. This heap is made of struct nolibc_blk
+ * blocks carved from its top, and freed blocks are merged with their free
+ * neighbours before being queued to a first-fit free list, or returned to the
+ * top when they are the last one. The slabs are only used if brk() fails. In
+ * this mode, the program must not move the program break by itself.
+ *
+ * When NOLIBC_STATIC_HEAP_SIZE is defined, the same kind of heap is instead
+ * carved from a static array of that many bytes in .bss, and serves all
+ * requests whatever their size, so that malloc() and free() never perform any
+ * system call and never touch the page tables. Requests which do not fit in
+ * the remaining space fail with ENOMEM. This takes precedence over
+ * NOLIBC_MALLOC_BRK.
+ *
+ * When NOLIBC_MALLOC_TLSF is defined in addition to one of these, the free
+ * blocks of the contiguous heap are indexed by a Two-Level Segregated Fit
+ * table instead of a single list: NOLIBC_TLSF_SL lists per power of two of
+ * the size, with bitmaps of the non-empty ones. Finding, queuing and removing
+ * a free block then take a bounded time regardless of fragmentation. Together
+ * with NOLIBC_STATIC_HEAP_SIZE, malloc() and free() run in constant time with
+ * no system call, which makes them usable in real-time loops.
+ *
+ * nolibc_malloc_huge() returns large blocks backed by huge pages, which are
+ * NOLIBC_MALLOC_HUGE_PAGE bytes large. It first tries to map them from the
+ * reserved hugetlb pool, which such blocks remember with NOLIBC_HEAP_HUGETLB
+ * in their length, and otherwise maps an area aligned to the huge page size
+ * and lets transparent huge pages back it. When NOLIBC_MALLOC_HUGE_MIN is
+ * defined, malloc() does this for requests of at least that many bytes.
+ *
+ * When NOLIBC_MALLOC_CACHE_MAX is defined, freed large blocks of at most that
+ * many bytes are not unmapped but kept in a cache of up to
+ * NOLIBC_MALLOC_CACHE_SLOTS mappings totalizing no more than
+ * NOLIBC_MALLOC_CACHE_MAX bytes, where the oldest ones are evicted first. Their
+ * pages are marked MADV_FREE (or MADV_DONTNEED on older kernels) so that the
+ * kernel may reclaim them under memory pressure, and later large requests
+ * take the smallest cached mapping which is large enough, trimming it if it
+ * is more than twice too large. This saves the mmap()/munmap() calls and page
+ * faults of programs repeatedly allocating and freeing similar large blocks.
+ *
+ * When NOLIBC_MALLOC_THREADS is defined, the allocator may be used by threads
+ * sharing the memory, such as those created with clone(CLONE_VM). A spinlock
+ * then protects the allocator's state, and small objects are exchanged with
+ * NOLIBC_MALLOC_TCACHES caches holding up to NOLIBC_MALLOC_TCACHE_MAX free
+ * objects per class, so that most small allocations and releases do not take
+ * it. There is no thread-local storage, so a thread uses the cache designated
+ * by a hash of its stack address, or any other unused one, and only refills
+ * or drains it by batches from the slabs, which act as a central depot. A
+ * release which finds its cache busy pushes the object without any lock to a
+ * per-class list that the next refill collects. Objects held in the caches are
+ * accounted as allocated.
+ *
+ * When NOLIBC_MALLOC_STATS is defined, the allocator maintains the counters
+ * of a struct nolibc_malloc_stats, which are reported by mallinfo2(),
+ * malloc_stats(), nolibc_malloc_get_stats() and nolibc_malloc_stats_fd(). The
+ * large blocks then also store their requested size to count the bytes lost
+ * to page rounding.
+ */
+#define NOLIBC_MALLOC_PAGE      4096UL
+#define NOLIBC_MALLOC_CHUNK     (16 * NOLIBC_MALLOC_PAGE)
+#define NOLIBC_MALLOC_SMALL_MAX 1024
+#define NOLIBC_MALLOC_CLASSES   12
+
+#ifndef NOLIBC_MALLOC_BRK_MAX
+#define NOLIBC_MALLOC_BRK_MAX   131072
+#endif
+
+#ifndef NOLIBC_MALLOC_BRK_STEP
+#define NOLIBC_MALLOC_BRK_STEP  65536
+#endif
+
+#ifndef NOLIBC_MALLOC_HUGE_PAGE
+#define NOLIBC_MALLOC_HUGE_PAGE (2UL << 20)
+#endif
+
+#if defined(NOLIBC_MALLOC_CACHE_MAX) && !defined(NOLIBC_MALLOC_CACHE_SLOTS)
+#define NOLIBC_MALLOC_CACHE_SLOTS 8
+#endif
+
+#if defined(NOLIBC_MALLOC_BRK) || defined(NOLIBC_STATIC_HEAP_SIZE)
+#define _NOLIBC_MALLOC_BLK
+#elif defined(NOLIBC_MALLOC_TLSF)
+#error NOLIBC_MALLOC_TLSF requires NOLIBC_STATIC_HEAP_SIZE or NOLIBC_MALLOC_BRK
+#endif
+
+/* TLSF second level: each power of two is split into 1 << NOLIBC_TLSF_SL_LOG
+ * lists. Sizes below NOLIBC_TLSF_SMALL all belong to the first level, in
+ * lists NOLIBC_TLSF_SMALL >> NOLIBC_TLSF_SL_LOG bytes apart.
+ */
+#define NOLIBC_TLSF_SL_LOG      4
+#define NOLIBC_TLSF_SL          (1 << NOLIBC_TLSF_SL_LOG)
+#define NOLIBC_TLSF_SMALL       (NOLIBC_TLSF_SL * __alignof__(struct nolibc_blk))
+#define NOLIBC_TLSF_FL          (8 * sizeof(size_t) - NOLIBC_TLSF_SL_LOG - 2)
+
+#if defined(NOLIBC_MALLOC_THREADS) && !defined(NOLIBC_STATIC_HEAP_SIZE)
+#define _NOLIBC_MALLOC_TCACHE
+#endif
+
+#ifndef NOLIBC_MALLOC_TCACHES
+#define NOLIBC_MALLOC_TCACHES   16
+#endif
+
+#ifndef NOLIBC_MALLOC_TCACHE_MAX
+#define NOLIBC_MALLOC_TCACHE_MAX 64
+#endif
+
+#define NOLIBC_HEAP_HUGETLB     2UL
+
 struct nolibc_heap {
-	size_t	len;
+	size_t	len;	/* size of the mapping, + NOLIBC_HEAP_HUGETLB */
+#if defined(NOLIBC_MALLOC_STATS)
+	size_t	req;	/* requested size */
+#endif
+	char	user_p[] __attribute__((__aligned__));
+};
+
+struct nolibc_slab {
+	size_t			tag;	/* (class << 1) + 1 */
+	struct nolibc_slab	*next;	/* next slab of this class with free objects */
+	struct nolibc_slab	*prev;	/* previous slab of this class with free objects */
+	void			*free;	/* first free object in this slab */
+	unsigned int		used;	/* number of allocated objects */
+};
+
+/* A block of the contiguous heap. Free blocks store their free list links in
+ * user_p. The previous block's size is always valid, and is zero for the first
+ * block.
+ */
+struct nolibc_blk {
+	size_t	prev_size;	/* size of the previous block */
+	size_t	size;		/* size of this block, header included, + NOLIBC_BLK_USED */
 	char	user_p[] __attribute__((__aligned__));
 };
 
+#define NOLIBC_BLK_USED 1UL
+#define NOLIBC_BLK_MIN  ((sizeof(struct nolibc_blk) + 2 * sizeof(void *) + \
+			  __alignof__(struct nolibc_blk) - 1) &                \
+			 -__alignof__(struct nolibc_blk))
+
+/* A cache of free slab objects, used by one thread at a time. Each one has its
+ * own cache line to avoid false sharing.
+ */
+struct nolibc_tcache {
+	int		lock;
+	unsigned short	count[NOLIBC_MALLOC_CLASSES];	/* objects in each list */
+	void		*free[NOLIBC_MALLOC_CLASSES];	/* free objects per class */
+} __attribute__((aligned(64)));
+
+/* Allocator counters. The per-class entries are indexed like the size classes,
+ * with an extra last entry for larger blocks.
+ */
+struct nolibc_malloc_stats {
+	size_t		live;		/* bytes usable in allocated blocks */
+	size_t		peak;		/* highest value reached by <live> */
+	size_t		mapped;		/* bytes obtained from mmap(), brk() or the static heap */
+	size_t		large;		/* allocated large blocks */
+	size_t		large_live;	/* bytes usable in allocated large blocks */
+	size_t		large_mapped;	/* bytes mapped by allocated large blocks */
+	size_t		slack;		/* bytes lost to page rounding in large blocks */
+	size_t		cached;		/* bytes mapped by cached large blocks */
+	unsigned long	cache_hits;	/* large blocks reused from the cache */
+	unsigned long	mmap_calls;
+	unsigned long	munmap_calls;
+	unsigned long	mremap_calls;
+	unsigned long	brk_calls;
+	unsigned long	allocs[NOLIBC_MALLOC_CLASSES + 1]; /* allocations per size class */
+	unsigned long	inuse[NOLIBC_MALLOC_CLASSES + 1];  /* allocated blocks per size class */
+};
+
+struct mallinfo2 {
+	size_t arena;    /* bytes obtained for small blocks */
+	size_t ordblks;  /* unused */
+	size_t smblks;   /* unused */
+	size_t hblks;    /* allocated large blocks */
+	size_t hblkhd;   /* bytes mapped by allocated large blocks */
+	size_t usmblks;  /* highest number of allocated bytes */
+	size_t fsmblks;  /* unused */
+	size_t uordblks; /* bytes allocated in small blocks */
+	size_t fordblks; /* free bytes in <arena> */
+	size_t keepcost; /* unused */
+};
+
+#if defined(NOLIBC_MALLOC_STATS)
+#define __NOLIBC_MALLOC_STAT(expr) do { __nolibc_malloc_state.stats.expr; } while (0)
+#else
+#define __NOLIBC_MALLOC_STAT(expr) do { } while (0)
+#endif
+
+struct nolibc_malloc_state {
+#if defined(NOLIBC_MALLOC_THREADS)
+	int			lock;	/* protects everything but the caches */
+#endif
+#if defined(_NOLIBC_MALLOC_TCACHE)
+	void			*remote[NOLIBC_MALLOC_CLASSES]; /* objects freed while their cache was busy */
+	struct nolibc_tcache	tcache[NOLIBC_MALLOC_TCACHES];
+#endif
+	struct nolibc_slab	*partial[NOLIBC_MALLOC_CLASSES]; /* slabs with free objects */
+	struct nolibc_slab	*pages;	/* unused slab pages */
+#if defined(_NOLIBC_MALLOC_BLK)
+	char			*heap_start; /* first block of the contiguous heap */
+	char			*heap_top;   /* first unallocated byte */
+	char			*heap_end;   /* end of the heap */
+	size_t			heap_last;   /* size of the block preceding heap_top */
+#if defined(NOLIBC_MALLOC_TLSF)
+	unsigned long		tlsf_fl;     /* non-empty first level entries */
+	unsigned long		tlsf_sl[NOLIBC_TLSF_FL]; /* non-empty lists per first level */
+	struct nolibc_blk	*tlsf[NOLIBC_TLSF_FL][NOLIBC_TLSF_SL]; /* free blocks */
+#else
+	struct nolibc_blk	*free_blks;  /* free blocks */
+#endif
+#endif
+#if defined(NOLIBC_MALLOC_CACHE_MAX)
+	struct nolibc_heap	*cache[NOLIBC_MALLOC_CACHE_SLOTS]; /* freed large blocks, newest first */
+	unsigned int		cache_cnt;   /* number of cached blocks */
+	size_t			cache_len;   /* bytes mapped by cached blocks */
+#endif
+#if defined(NOLIBC_MALLOC_STATS)
+	struct nolibc_malloc_stats stats;
+#endif
+};
+
+/* shared by all units so that memory may be freed by another one */
+__attribute__((weak,unused,section(".data.nolibc_malloc")))
+struct nolibc_malloc_state __nolibc_malloc_state;
+
+#if defined(NOLIBC_STATIC_HEAP_SIZE)
+__attribute__((weak,unused,aligned(__alignof__(struct nolibc_blk)),section(".bss.nolibc_heap")))
+char __nolibc_static_heap[NOLIBC_STATIC_HEAP_SIZE];
+#endif
+
+static const unsigned short __nolibc_malloc_class[NOLIBC_MALLOC_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024
+};
+
 /* Buffer used to store int-to-ASCII conversions. Will only be implemented if
  * any of the related functions is implemented. The area is large enough to
  * store "18446744073709551615" or "-9223372036854775808" and the final zero.
  */
 static __attribute__((unused)) char itoa_buffer[21];
 
+static void *nolibc_malloc_huge(size_t len);
+static int dprintf(int fd, const char *fmt, ...);
+
+#if defined(NOLIBC_MALLOC_THREADS)
+/* waits for spinlock <lock> to be free and takes it */
+static __inline__ __attribute__((unused))
+void __nolibc_spin_lock(int *lock)
+{
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED))
+			sys_sched_yield();
+	}
+}
+
+/* takes spinlock <lock> if it is free, and returns non-zero on success */
+static __inline__ __attribute__((unused))
+int __nolibc_spin_trylock(int *lock)
+{
+	return !__atomic_load_n(lock, __ATOMIC_RELAXED) &&
+	       !__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);
+}
+
+static __inline__ __attribute__((unused))
+void __nolibc_spin_unlock(int *lock)
+{
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+#define __nolibc_malloc_lock()   __nolibc_spin_lock(&__nolibc_malloc_state.lock)
+#define __nolibc_malloc_unlock() __nolibc_spin_unlock(&__nolibc_malloc_state.lock)
+#else
+#define __nolibc_malloc_lock()   do { } while (0)
+#define __nolibc_malloc_unlock() do { } while (0)
+#endif /* NOLIBC_MALLOC_THREADS */
+
+/* returns the slab or large block header of an allocated pointer */
+static __inline__ __attribute__((unused))
+void *__nolibc_malloc_hdr(const void *ptr)
+{
+	return (void *)(((unsigned long)ptr - 1) & -NOLIBC_MALLOC_PAGE);
+}
+
+/* Maps <len> bytes, a multiple of the page size, such that the area's start
+ * plus <ofs>, also a multiple of the page size, is aligned to <align>, which
+ * is a power of two. Returns MAP_FAILED on failure.
+ */
+static __attribute__((unused))
+void *__nolibc_mmap_aligned(size_t len, size_t align, size_t ofs)
+{
+	char *area, *start, *end;
+
+	if (align < NOLIBC_MALLOC_PAGE)
+		align = NOLIBC_MALLOC_PAGE;
+
+	area = mmap(NULL, len + align - NOLIBC_MALLOC_PAGE, PROT_READ|PROT_WRITE,
+		    MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+	__NOLIBC_MALLOC_STAT(mmap_calls++);
+	if (__builtin_expect(area == MAP_FAILED, 0) || align == NOLIBC_MALLOC_PAGE)
+		return area;
+
+	/* trim the excess on both sides */
+	end   = area + len + align - NOLIBC_MALLOC_PAGE;
+	start = (char *)((((unsigned long)area + ofs + align - 1) & -align) - ofs);
+	if (start > area) {
+		sys_munmap(area, start - area);
+		__NOLIBC_MALLOC_STAT(munmap_calls++);
+	}
+	if (start + len < end) {
+		sys_munmap(start + len, end - (start + len));
+		__NOLIBC_MALLOC_STAT(munmap_calls++);
+	}
+	return start;
+}
+
+#if defined(NOLIBC_MALLOC_CACHE_MAX)
+/* unmaps the oldest cached block */
+static __attribute__((unused))
+void __nolibc_cache_evict(void)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_heap *heap = st->cache[--st->cache_cnt];
+
+	st->cache_len -= heap->len;
+	__NOLIBC_MALLOC_STAT(cached -= heap->len);
+	__NOLIBC_MALLOC_STAT(mapped -= heap->len);
+	__NOLIBC_MALLOC_STAT(munmap_calls++);
+	sys_munmap(heap, heap->len);
+}
+
+/* returns a cached mapping of at least <len> bytes, or NULL if none fits */
+static __attribute__((unused))
+struct nolibc_heap *__nolibc_cache_get(size_t len)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_heap *heap = NULL;
+	unsigned int i, best = 0;
+
+	for (i = 0; i < st->cache_cnt; i++) {
+		if (st->cache[i]->len >= len && (!heap || st->cache[i]->len < heap->len)) {
+			heap = st->cache[i];
+			best = i;
+		}
+	}
+
+	if (!heap)
+		return NULL;
+
+	st->cache_cnt--;
+	for (i = best; i < st->cache_cnt; i++)
+		st->cache[i] = st->cache[i + 1];
+	st->cache_len -= heap->len;
+	__NOLIBC_MALLOC_STAT(cached -= heap->len);
+	__NOLIBC_MALLOC_STAT(cache_hits++);
+
+	if (heap->len / 2 >= len) {
+		/* don't waste more than the block itself */
+		__NOLIBC_MALLOC_STAT(munmap_calls++);
+		if (sys_munmap((char *)heap + len, heap->len - len) == 0) {
+			__NOLIBC_MALLOC_STAT(mapped -= heap->len - len);
+			heap->len = len;
+		}
+	}
+	return heap;
+}
+
+/* Keeps freed large block <heap> for later reuse, possibly evicting older
+ * ones. Returns non-zero if it was cached, or zero if it must be unmapped.
+ */
+static __attribute__((unused))
+int __nolibc_cache_put(struct nolibc_heap *heap)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	size_t len = heap->len;
+	unsigned int i;
+
+	/* hugetlb pages cannot be lazily freed */
+	if ((len & NOLIBC_HEAP_HUGETLB) || len > NOLIBC_MALLOC_CACHE_MAX)
+		return 0;
+
+	/* the header's page is kept to retrieve the length */
+	if (sys_madvise((char *)heap + NOLIBC_MALLOC_PAGE, len - NOLIBC_MALLOC_PAGE, MADV_FREE) < 0 &&
+	    sys_madvise((char *)heap + NOLIBC_MALLOC_PAGE, len - NOLIBC_MALLOC_PAGE, MADV_DONTNEED) < 0)
+		return 0;
+
+	while (st->cache_cnt &&
+	       (st->cache_cnt == NOLIBC_MALLOC_CACHE_SLOTS || st->cache_len + len > NOLIBC_MALLOC_CACHE_MAX))
+		__nolibc_cache_evict();
+
+	for (i = st->cache_cnt++; i > 0; i--)
+		st->cache[i] = st->cache[i - 1];
+	st->cache[0] = heap;
+	st->cache_len += len;
+	__NOLIBC_MALLOC_STAT(cached += len);
+	return 1;
+}
+#else
+static __inline__ __attribute__((unused))
+struct nolibc_heap *__nolibc_cache_get(size_t len __attribute__((unused)))
+{
+	return NULL;
+}
+
+static __inline__ __attribute__((unused))
+int __nolibc_cache_put(struct nolibc_heap *heap __attribute__((unused)))
+{
+	return 0;
+}
+#endif /* NOLIBC_MALLOC_CACHE_MAX */
+
+#if defined(_NOLIBC_MALLOC_BLK)
+/* returns non-zero if <ptr> belongs to the contiguous heap */
+static __inline__ __attribute__((unused))
+int __nolibc_blk_owns(const void *ptr)
+{
+	const struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+
+	return (const char *)ptr >= st->heap_start && (const char *)ptr < st->heap_top;
+}
+
+/* makes sure at least <need> bytes are available above the heap's top */
+#if defined(NOLIBC_STATIC_HEAP_SIZE)
+static __attribute__((unused))
+int __nolibc_blk_grow(size_t need)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+
+	if (!st->heap_end) {
+		st->heap_start = st->heap_top = __nolibc_static_heap;
+		st->heap_end = __nolibc_static_heap + NOLIBC_STATIC_HEAP_SIZE;
+		__NOLIBC_MALLOC_STAT(mapped += NOLIBC_STATIC_HEAP_SIZE);
+	}
+
+	if (need > (size_t)(st->heap_end - st->heap_top))
+		return -1;
+	return 0;
+}
+#else
+static __attribute__((unused))
+int __nolibc_blk_grow(size_t need)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	char *end;
+
+	if (!st->heap_end) {
+		/* first call, start at the current break */
+		end = sys_brk(NULL);
+		st->heap_start = (char *)(((unsigned long)end + __alignof__(struct nolibc_blk) - 1) &
+					  -__alignof__(struct nolibc_blk));
+		st->heap_top = st->heap_end = st->heap_start;
+	}
+
+	if (need <= (size_t)(st->heap_end - st->heap_top))
+		return 0;
+
+	need = (need - (st->heap_end - st->heap_top) + NOLIBC_MALLOC_BRK_STEP - 1) &
+	       -(size_t)NOLIBC_MALLOC_BRK_STEP;
+	end = sys_brk(st->heap_end + need);
+	__NOLIBC_MALLOC_STAT(brk_calls++);
+	if (end != st->heap_end + need)
+		return -1;
+
+	__NOLIBC_MALLOC_STAT(mapped += need);
+	st->heap_end = end;
+	return 0;
+}
+#endif /* NOLIBC_STATIC_HEAP_SIZE */
+
+#if defined(NOLIBC_MALLOC_TLSF)
+/* computes the TLSF first and second level indexes of blocks of <size> bytes */
+static __inline__ __attribute__((unused))
+void __nolibc_tlsf_map(size_t size, unsigned int *fl, unsigned int *sl)
+{
+	unsigned int log;
+
+	if (size < NOLIBC_TLSF_SMALL) {
+		*fl = 0;
+		*sl = size / __alignof__(struct nolibc_blk);
+		return;
+	}
+	log = 8 * sizeof(long) - 1 - __builtin_clzl(size);
+	*sl = (size >> (log - NOLIBC_TLSF_SL_LOG)) - NOLIBC_TLSF_SL;
+	*fl = log - __builtin_ctzl(NOLIBC_TLSF_SMALL) + 1;
+}
+
+/* returns a free block of at least <need> bytes, or NULL if there is none */
+static __attribute__((unused))
+struct nolibc_blk *__nolibc_blk_find(size_t need)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	unsigned int fl, sl;
+	unsigned long map;
+
+	/* start from the next list so that any of its blocks is large enough */
+	if (need >= NOLIBC_TLSF_SMALL)
+		need += (1UL << (8 * sizeof(long) - 1 - __builtin_clzl(need) - NOLIBC_TLSF_SL_LOG)) - 1;
+	__nolibc_tlsf_map(need, &fl, &sl);
+
+	map = st->tlsf_sl[fl] & (~0UL << sl);
+	if (!map) {
+		map = st->tlsf_fl & (~0UL << (fl + 1));
+		if (!map)
+			return NULL;
+		fl = __builtin_ctzl(map);
+		map = st->tlsf_sl[fl];
+	}
+	return st->tlsf[fl][__builtin_ctzl(map)];
+}
+#else
+/* returns the first free block of at least <need> bytes, or NULL */
+static __attribute__((unused))
+struct nolibc_blk *__nolibc_blk_find(size_t need)
+{
+	struct nolibc_blk *blk;
+
+	for (blk = __nolibc_malloc_state.free_blks; blk; blk = ((struct nolibc_blk **)blk->user_p)[0])
+		if (blk->size >= need)
+			break;
+	return blk;
+}
+#endif /* NOLIBC_MALLOC_TLSF */
+
+/* queues free block <blk> of size <size> and updates its neighbour */
+static __attribute__((unused))
+void __nolibc_blk_insert(struct nolibc_blk *blk, size_t size)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_blk **link = (struct nolibc_blk **)blk->user_p;
+	struct nolibc_blk **head;
+#if defined(NOLIBC_MALLOC_TLSF)
+	unsigned int fl, sl;
+
+	__nolibc_tlsf_map(size, &fl, &sl);
+	head = &st->tlsf[fl][sl];
+	st->tlsf_fl |= 1UL << fl;
+	st->tlsf_sl[fl] |= 1UL << sl;
+#else
+	head = &st->free_blks;
+#endif
+
+	blk->size = size;
+	if ((char *)blk + size == st->heap_top)
+		st->heap_last = size;
+	else
+		((struct nolibc_blk *)((char *)blk + size))->prev_size = size;
+
+	link[0] = *head;
+	link[1] = NULL;
+	if (*head)
+		((struct nolibc_blk **)(*head)->user_p)[1] = blk;
+	*head = blk;
+}
+
+/* removes free block <blk> from the free list */
+static __attribute__((unused))
+void __nolibc_blk_unlink(struct nolibc_blk *blk)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_blk **link = (struct nolibc_blk **)blk->user_p;
+#if defined(NOLIBC_MALLOC_TLSF)
+	unsigned int fl, sl;
+#endif
+
+	if (link[1]) {
+		((struct nolibc_blk **)link[1]->user_p)[0] = link[0];
+	} else {
+#if defined(NOLIBC_MALLOC_TLSF)
+		__nolibc_tlsf_map(blk->size, &fl, &sl);
+		st->tlsf[fl][sl] = link[0];
+		if (!link[0] && !(st->tlsf_sl[fl] &= ~(1UL << sl)))
+			st->tlsf_fl &= ~(1UL << fl);
+#else
+		st->free_blks = link[0];
+#endif
+	}
+	if (link[0])
+		((struct nolibc_blk **)link[0]->user_p)[1] = link[1];
+}
+
+/* returns <len> bytes from the contiguous heap, or NULL if it cannot grow */
+static __attribute__((unused))
+void *__nolibc_blk_alloc(size_t len)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_blk *blk;
+	size_t need, size;
+
+	need = (sizeof(*blk) + len + __alignof__(struct nolibc_blk) - 1) &
+	       -__alignof__(struct nolibc_blk);
+	if (need < NOLIBC_BLK_MIN)
+		need = NOLIBC_BLK_MIN;
+
+	blk = __nolibc_blk_find(need);
+	if (blk) {
+		__nolibc_blk_unlink(blk);
+		size = blk->size;
+		if (size - need >= NOLIBC_BLK_MIN) {
+			((struct nolibc_blk *)((char *)blk + need))->prev_size = need;
+			__nolibc_blk_insert((struct nolibc_blk *)((char *)blk + need), size - need);
+			size = need;
+		}
+		blk->size = size | NOLIBC_BLK_USED;
+		return blk->user_p;
+	}
+
+	if (__nolibc_blk_grow(need) < 0)
+		return NULL;
+
+	blk = (struct nolibc_blk *)st->heap_top;
+	blk->prev_size = st->heap_last;
+	blk->size = need | NOLIBC_BLK_USED;
+	st->heap_top += need;
+	st->heap_last = need;
+	return blk->user_p;
+}
+
+/* releases <ptr> into the contiguous heap, merging it with free neighbours */
+static __attribute__((unused))
+void __nolibc_blk_free(void *ptr)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_blk *blk = container_of(ptr, struct nolibc_blk, user_p);
+	struct nolibc_blk *next, *prev;
+	size_t size = blk->size & ~NOLIBC_BLK_USED;
+
+	next = (struct nolibc_blk *)((char *)blk + size);
+	if ((char *)next != st->heap_top && !(next->size & NOLIBC_BLK_USED)) {
+		__nolibc_blk_unlink(next);
+		size += next->size;
+	}
+
+	prev = (struct nolibc_blk *)((char *)blk - blk->prev_size);
+	if (blk->prev_size && !(prev->size & NOLIBC_BLK_USED)) {
+		__nolibc_blk_unlink(prev);
+		size += prev->size;
+		blk = prev;
+	}
+
+	if ((char *)blk + size == st->heap_top) {
+		st->heap_top = (char *)blk;
+		st->heap_last = blk->prev_size;
+		return;
+	}
+	__nolibc_blk_insert(blk, size);
+}
+
+/* splits allocated block <blk> after its first <size> bytes and returns the
+ * second part, which is also marked allocated.
+ */
+static __attribute__((unused))
+struct nolibc_blk *__nolibc_blk_split(struct nolibc_blk *blk, size_t size)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_blk *next = (struct nolibc_blk *)((char *)blk + size);
+	size_t rest = (blk->size & ~NOLIBC_BLK_USED) - size;
+
+	blk->size = size | NOLIBC_BLK_USED;
+	next->prev_size = size;
+	next->size = rest | NOLIBC_BLK_USED;
+	if ((char *)next + rest == st->heap_top)
+		st->heap_last = rest;
+	else
+		((struct nolibc_blk *)((char *)next + rest))->prev_size = rest;
+	return next;
+}
+
+/* Returns <len> bytes aligned to <align>, a power of two, from the contiguous
+ * heap, or NULL if it cannot grow. The excess on both sides is released.
+ */
+static __attribute__((unused))
+void *__nolibc_blk_alloc_aligned(size_t len, size_t align)
+{
+	struct nolibc_blk *blk, *prev;
+	char *ptr, *aligned;
+	size_t need;
+
+	ptr = __nolibc_blk_alloc(len + align + NOLIBC_BLK_MIN);
+	if (!ptr)
+		return NULL;
+
+	/* a leading part must be large enough to form a free block */
+	blk = container_of((void *)ptr, struct nolibc_blk, user_p);
+	aligned = (char *)(((unsigned long)ptr + align - 1) & -align);
+	if (aligned != ptr && (size_t)(aligned - ptr) < NOLIBC_BLK_MIN)
+		aligned += align;
+
+	if (aligned != ptr) {
+		prev = blk;
+		blk = __nolibc_blk_split(prev, aligned - ptr);
+		__nolibc_blk_free(prev->user_p);
+	}
+
+	need = (sizeof(*blk) + len + __alignof__(struct nolibc_blk) - 1) &
+	       -__alignof__(struct nolibc_blk);
+	if (need < NOLIBC_BLK_MIN)
+		need = NOLIBC_BLK_MIN;
+	if ((blk->size & ~NOLIBC_BLK_USED) - need >= NOLIBC_BLK_MIN)
+		__nolibc_blk_free(__nolibc_blk_split(blk, need)->user_p);
+	return blk->user_p;
+}
+#else
+static __inline__ __attribute__((unused))
+int __nolibc_blk_owns(const void *ptr __attribute__((unused)))
+{
+	return 0;
+}
+#endif /* _NOLIBC_MALLOC_BLK */
+
+/* returns the number of bytes usable at <ptr> which must have been allocated */
+static __attribute__((unused))
+size_t __nolibc_malloc_size(const void *ptr)
+{
+	const struct nolibc_heap *heap = __nolibc_malloc_hdr(ptr);
+
+	if (__nolibc_blk_owns(ptr))
+		return (container_of((void *)ptr, struct nolibc_blk, user_p)->size & ~NOLIBC_BLK_USED) -
+		       sizeof(struct nolibc_blk);
+
+	if (heap->len & 1)
+		return __nolibc_malloc_class[heap->len >> 1];
+	return (heap->len & ~NOLIBC_HEAP_HUGETLB) - ((const char *)ptr - (const char *)heap);
+}
+
+#if defined(NOLIBC_MALLOC_STATS)
+/* accounts for block <ptr> being allocated (<dir> > 0) or released (<dir> < 0) */
+static __attribute__((unused))
+void __nolibc_malloc_count(const void *ptr, int dir)
+{
+	struct nolibc_malloc_stats *stats = &__nolibc_malloc_state.stats;
+	const struct nolibc_heap *heap = __nolibc_malloc_hdr(ptr);
+	size_t size = __nolibc_malloc_size(ptr);
+	size_t len, slack;
+	unsigned int cls;
+
+	for (cls = 0; cls < NOLIBC_MALLOC_CLASSES && __nolibc_malloc_class[cls] < size; cls++)
+		;
+
+	if (dir > 0) {
+		stats->allocs[cls]++;
+		stats->inuse[cls]++;
+		stats->live += size;
+		if (stats->live > stats->peak)
+			stats->peak = stats->live;
+	} else {
+		stats->inuse[cls]--;
+		stats->live -= size;
+	}
+
+	if (__nolibc_blk_owns(ptr) || (heap->len & 1))
+		return;
+
+	len = heap->len & ~NOLIBC_HEAP_HUGETLB;
+	slack = size - heap->req;
+	if (dir < 0) {
+		size  = -size;
+		len   = -len;
+		slack = -slack;
+	}
+	stats->large        += dir;
+	stats->large_live   += size;
+	stats->large_mapped += len;
+	stats->slack        += slack;
+}
+#else
+#define __nolibc_malloc_count(ptr, dir) do { } while (0)
+#endif
+
+/* returns a free object of class <cls>, or NULL if no more memory is
+ * available.
+ */
+static __attribute__((unused))
+void *__nolibc_slab_alloc(unsigned int cls)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	struct nolibc_slab *slab = st->partial[cls];
+	size_t size = __nolibc_malloc_class[cls];
+	size_t ofs;
+	char *chunk;
+	void *obj;
+
+	if (!slab) {
+		slab = st->pages;
+		if (!slab) {
+			chunk = mmap(NULL, NOLIBC_MALLOC_CHUNK, PROT_READ|PROT_WRITE,
+				     MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+			__NOLIBC_MALLOC_STAT(mmap_calls++);
+			if (__builtin_expect(chunk == MAP_FAILED, 0))
+				return NULL;
+
+			__NOLIBC_MALLOC_STAT(mapped += NOLIBC_MALLOC_CHUNK);
+			/* keep the first page, queue the other ones */
+			for (ofs = NOLIBC_MALLOC_CHUNK; (ofs -= NOLIBC_MALLOC_PAGE); ) {
+				slab = (struct nolibc_slab *)(chunk + ofs);
+				slab->next = st->pages;
+				st->pages = slab;
+			}
+			slab = (struct nolibc_slab *)chunk;
+		} else {
+			st->pages = slab->next;
+		}
+
+		slab->tag  = (cls << 1) + 1;
+		slab->used = 0;
+		slab->free = NULL;
+		slab->next = slab->prev = NULL;
+		for (ofs = NOLIBC_MALLOC_PAGE; ofs >= sizeof(*slab) + size; ) {
+			ofs -= size;
+			*(void **)((char *)slab + ofs) = slab->free;
+			slab->free = (char *)slab + ofs;
+		}
+		st->partial[cls] = slab;
+	}
+
+	obj = slab->free;
+	slab->free = *(void **)obj;
+	slab->used++;
+
+	if (!slab->free) {
+		/* full, only freed objects will make it usable again */
+		st->partial[cls] = slab->next;
+		if (slab->next)
+			slab->next->prev = NULL;
+	}
+	return obj;
+}
+
+/* releases object <ptr> into its slab <slab> */
+static __attribute__((unused))
+void __nolibc_slab_free(struct nolibc_slab *slab, void *ptr)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	unsigned int cls = slab->tag >> 1;
+
+	if (!slab->free) {
+		/* was full, make it available again */
+		slab->prev = NULL;
+		slab->next = st->partial[cls];
+		if (slab->next)
+			slab->next->prev = slab;
+		st->partial[cls] = slab;
+	}
+
+	*(void **)ptr = slab->free;
+	slab->free = ptr;
+
+	/* Recycle the page once empty, unless it is the last one of its class,
+	 * which avoids rebuilding it over and over for a single object.
+	 */
+	if (--slab->used || (!slab->prev && !slab->next))
+		return;
+
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		st->partial[cls] = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+
+	slab->next = st->pages;
+	st->pages = slab;
+}
+
+#if defined(_NOLIBC_MALLOC_TCACHE)
+/* Locks and returns the calling thread's cache if it is available, otherwise
+ * if <any> is non-zero, any other available one, or NULL if none is.
+ */
+static __attribute__((unused))
+struct nolibc_tcache *__nolibc_tcache_get(int any)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	unsigned int idx, i;
+
+	/* threads' stacks are far apart, hash their 64kB area */
+	idx = (unsigned int)((unsigned long)__builtin_frame_address(0) >> 16) * 2654435761U;
+	idx = (idx >> 16) % NOLIBC_MALLOC_TCACHES;
+
+	for (i = 0; i < NOLIBC_MALLOC_TCACHES; i++) {
+		if (__nolibc_spin_trylock(&st->tcache[idx].lock))
+			return &st->tcache[idx];
+		if (!any)
+			break;
+		if (++idx == NOLIBC_MALLOC_TCACHES)
+			idx = 0;
+	}
+	return NULL;
+}
+
+/* Refills the list of class <cls> of locked cache <tc>, with the objects freed
+ * while their cache was busy if any, otherwise with half a cache worth of
+ * objects from the slabs. Remote objects beyond a full cache are returned to
+ * their slabs.
+ */
+static __attribute__((unused))
+void __nolibc_tcache_refill(struct nolibc_tcache *tc, unsigned int cls)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	unsigned int count;
+	void *obj, *rest;
+
+	obj = __atomic_exchange_n(&st->remote[cls], NULL, __ATOMIC_ACQUIRE);
+	if (obj) {
+		tc->free[cls] = obj;
+		for (count = 1; count < NOLIBC_MALLOC_TCACHE_MAX && *(void **)obj; count++)
+			obj = *(void **)obj;
+		tc->count[cls] = count;
+		rest = *(void **)obj;
+		*(void **)obj = NULL;
+		if (!rest)
+			return;
+
+		__nolibc_malloc_lock();
+		while ((obj = rest)) {
+			rest = *(void **)obj;
+			__nolibc_malloc_count(obj, -1);
+			__nolibc_slab_free(__nolibc_malloc_hdr(obj), obj);
+		}
+		__nolibc_malloc_unlock();
+		return;
+	}
+
+	__nolibc_malloc_lock();
+	for (count = 0; count < NOLIBC_MALLOC_TCACHE_MAX / 2; count++) {
+		obj = __nolibc_slab_alloc(cls);
+		if (!obj)
+			break;
+		__nolibc_malloc_count(obj, 1);
+		*(void **)obj = tc->free[cls];
+		tc->free[cls] = obj;
+	}
+	__nolibc_malloc_unlock();
+	tc->count[cls] = count;
+}
+
+/* returns an object of class <cls> from a cache, or NULL if none is available */
+static __attribute__((unused))
+void *__nolibc_tcache_alloc(unsigned int cls)
+{
+	struct nolibc_tcache *tc = __nolibc_tcache_get(1);
+	void *obj;
+
+	if (!tc)
+		return NULL;
+
+	if (!tc->free[cls])
+		__nolibc_tcache_refill(tc, cls);
+
+	obj = tc->free[cls];
+	if (obj) {
+		tc->free[cls] = *(void **)obj;
+		tc->count[cls]--;
+	}
+	__nolibc_spin_unlock(&tc->lock);
+	return obj;
+}
+
+/* releases slab object <ptr> into the calling thread's cache */
+static __attribute__((unused))
+void __nolibc_tcache_free(void *ptr)
+{
+	struct nolibc_malloc_state *st = &__nolibc_malloc_state;
+	unsigned int cls = ((struct nolibc_slab *)__nolibc_malloc_hdr(ptr))->tag >> 1;
+	struct nolibc_tcache *tc = __nolibc_tcache_get(0);
+	void *obj;
+
+	if (!tc) {
+		/* the cache is busy, the next refill will collect it */
+		obj = __atomic_load_n(&st->remote[cls], __ATOMIC_RELAXED);
+		do {
+			*(void **)ptr = obj;
+		} while (!__atomic_compare_exchange_n(&st->remote[cls], &obj, ptr, 1,
+						      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+		return;
+	}
+
+	*(void **)ptr = tc->free[cls];
+	tc->free[cls] = ptr;
+	if (++tc->count[cls] > NOLIBC_MALLOC_TCACHE_MAX) {
+		/* return half of them to their slabs */
+		__nolibc_malloc_lock();
+		while (tc->count[cls] > NOLIBC_MALLOC_TCACHE_MAX / 2) {
+			obj = tc->free[cls];
+			tc->free[cls] = *(void **)obj;
+			tc->count[cls]--;
+			__nolibc_malloc_count(obj, -1);
+			__nolibc_slab_free(__nolibc_malloc_hdr(obj), obj);
+		}
+		__nolibc_malloc_unlock();
+	}
+	__nolibc_spin_unlock(&tc->lock);
+}
+#endif /* _NOLIBC_MALLOC_TCACHE */
+
+/* Returns <len> bytes, which are zeroed if <zero> is non-zero, or NULL if no
+ * more memory is available.
+ */
+#if defined(NOLIBC_STATIC_HEAP_SIZE)
+static __attribute__((unused))
+void *__nolibc_malloc(size_t len, int zero)
+{
+	void *ret = NULL;
+
+	__nolibc_malloc_lock();
+	if (len <= NOLIBC_STATIC_HEAP_SIZE)
+		ret = __nolibc_blk_alloc(len);
+	if (ret)
+		__nolibc_malloc_count(ret, 1);
+	else
+		SET_ERRNO(ENOMEM);
+	__nolibc_malloc_unlock();
+	if (ret && zero)
+		memset(ret, 0, len);
+	return ret;
+}
+#else
+static __attribute__((unused))
+void *__nolibc_malloc(size_t len, int zero)
+{
+	struct nolibc_heap *heap;
+	unsigned int cls;
+	size_t size;
+	void *ret;
+
+#if defined(NOLIBC_MALLOC_HUGE_MIN)
+	if (len >= NOLIBC_MALLOC_HUGE_MIN)
+		return nolibc_malloc_huge(len);
+#endif
+
+	for (cls = 0; cls < NOLIBC_MALLOC_CLASSES && __nolibc_malloc_class[cls] < len; cls++)
+		;
+
+#if defined(_NOLIBC_MALLOC_TCACHE)
+	if (cls < NOLIBC_MALLOC_CLASSES) {
+		ret = __nolibc_tcache_alloc(cls);
+		if (ret) {
+			if (zero)
+				memset(ret, 0, len);
+			return ret;
+		}
+	}
+#endif
+
+	__nolibc_malloc_lock();
+
+#if defined(NOLIBC_MALLOC_BRK)
+	if (len <= NOLIBC_MALLOC_BRK_MAX) {
+		ret = __nolibc_blk_alloc(len);
+		if (ret)
+			goto out;
+	}
+#endif
+
+	if (cls < NOLIBC_MALLOC_CLASSES) {
+		ret = __nolibc_slab_alloc(cls);
+		goto out;
+	}
+
+	ret = NULL;
+	if (__builtin_expect(len > -NOLIBC_MALLOC_PAGE - sizeof(*heap), 0)) {
+		SET_ERRNO(ENOMEM);
+		goto out;
+	}
+
+	/* Always allocate memory with size multiple of 4096. */
+	size = sizeof(*heap) + len;
+	size = (size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	heap = __nolibc_cache_get(size);
+	if (heap)
+		goto large;
+
+	/* fresh anonymous mappings are already zeroed */
+	zero = 0;
+	heap = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE,
+		    -1, 0);
+	__NOLIBC_MALLOC_STAT(mmap_calls++);
+	if (__builtin_expect(heap == MAP_FAILED, 0))
+		goto out;
+
+	__NOLIBC_MALLOC_STAT(mapped += size);
+	heap->len = size;
+ large:
+#if defined(NOLIBC_MALLOC_STATS)
+	heap->req = len;
+#endif
+	ret = heap->user_p;
+ out:
+	if (ret)
+		__nolibc_malloc_count(ret, 1);
+	__nolibc_malloc_unlock();
+	if (ret && zero)
+		memset(ret, 0, len);
+	return ret;
+}
+#endif /* NOLIBC_STATIC_HEAP_SIZE */
+
 /*
  * As much as possible, please keep functions alphabetically sorted.
  */
@@ -78,6 +1175,81 @@ void abort(void)
 	for (;;);
 }
 
+/* Returns <size> bytes aligned to <alignment>, which must be a power of two,
+ * or NULL on failure. The block may be passed to free() and realloc(), though
+ * the latter does not preserve the alignment when it needs to move the block.
+ * Small blocks are taken from the first class which is a multiple of the
+ * alignment, larger ones have their own mapping and do not waste more than
+ * the rounding to pages.
+ */
+static __attribute__((unused))
+void *aligned_alloc(size_t alignment, size_t size)
+{
+#if !defined(NOLIBC_STATIC_HEAP_SIZE)
+	struct nolibc_heap *heap;
+	unsigned int cls;
+	size_t ofs, len;
+#endif
+	void *ret;
+
+	if (__builtin_expect(alignment & (alignment - 1), 0)) {
+		SET_ERRNO(EINVAL);
+		return NULL;
+	}
+
+	if (alignment <= __alignof__(struct nolibc_heap))
+		return malloc(size);
+
+	__nolibc_malloc_lock();
+#if defined(NOLIBC_STATIC_HEAP_SIZE)
+	ret = NULL;
+	if (size <= NOLIBC_STATIC_HEAP_SIZE && alignment <= NOLIBC_STATIC_HEAP_SIZE)
+		ret = __nolibc_blk_alloc_aligned(size, alignment);
+	if (ret)
+		__nolibc_malloc_count(ret, 1);
+	else
+		SET_ERRNO(ENOMEM);
+	__nolibc_malloc_unlock();
+	return ret;
+#else
+	if (size <= NOLIBC_MALLOC_SMALL_MAX && alignment <= NOLIBC_MALLOC_SMALL_MAX) {
+		for (cls = 0; __nolibc_malloc_class[cls] < size ||
+			      (__nolibc_malloc_class[cls] & (alignment - 1)); cls++)
+			;
+		ret = __nolibc_slab_alloc(cls);
+		goto out;
+	}
+
+	/* the user area follows the header, or starts on the next page */
+	ofs = (sizeof(*heap) + alignment - 1) & -alignment;
+	if (ofs > NOLIBC_MALLOC_PAGE)
+		ofs = NOLIBC_MALLOC_PAGE;
+
+	ret = NULL;
+	if (__builtin_expect(size > -NOLIBC_MALLOC_PAGE - ofs - alignment, 0)) {
+		SET_ERRNO(ENOMEM);
+		goto out;
+	}
+
+	len  = (ofs + size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	heap = __nolibc_mmap_aligned(len, alignment, ofs);
+	if (__builtin_expect(heap == MAP_FAILED, 0))
+		goto out;
+
+	__NOLIBC_MALLOC_STAT(mapped += len);
+	heap->len = len;
+#if defined(NOLIBC_MALLOC_STATS)
+	heap->req = size;
+#endif
+	ret = (char *)heap + ofs;
+ out:
+	if (ret)
+		__nolibc_malloc_count(ret, 1);
+	__nolibc_malloc_unlock();
+	return ret;
+#endif /* NOLIBC_STATIC_HEAP_SIZE */
+}
+
 static __attribute__((unused))
 long atol(const char *s)
 {
@@ -115,8 +1287,37 @@ void free(void *ptr)
 	if (!ptr)
 		return;
 
-	heap = container_of(ptr, struct nolibc_heap, user_p);
-	munmap(heap, heap->len);
+	heap = __nolibc_malloc_hdr(ptr);
+#if defined(_NOLIBC_MALLOC_TCACHE)
+	if (!__nolibc_blk_owns(ptr) && (heap->len & 1)) {
+		__nolibc_tcache_free(ptr);
+		return;
+	}
+#endif
+
+	__nolibc_malloc_lock();
+	__nolibc_malloc_count(ptr, -1);
+
+#if defined(_NOLIBC_MALLOC_BLK)
+	if (__nolibc_blk_owns(ptr)) {
+		__nolibc_blk_free(ptr);
+		goto out;
+	}
+#endif
+
+	if (heap->len & 1) {
+		__nolibc_slab_free((struct nolibc_slab *)heap, ptr);
+		goto out;
+	}
+
+	if (__nolibc_cache_put(heap))
+		goto out;
+
+	__NOLIBC_MALLOC_STAT(munmap_calls++);
+	__NOLIBC_MALLOC_STAT(mapped -= heap->len & ~NOLIBC_HEAP_HUGETLB);
+	munmap(heap, heap->len & ~NOLIBC_HEAP_HUGETLB);
+ out:
+	__nolibc_malloc_unlock();
 }
 
 /* getenv() tries to find the environment variable named <name> in the
@@ -142,23 +1343,150 @@ char *getenv(const char *name)
 	return NULL;
 }
 
+#if defined(NOLIBC_MALLOC_STATS)
+/* returns the allocator's counters in the format used by glibc */
+static __attribute__((unused))
+struct mallinfo2 mallinfo2(void)
+{
+	const struct nolibc_malloc_stats *stats = &__nolibc_malloc_state.stats;
+	struct mallinfo2 mi;
+
+	memset(&mi, 0, sizeof(mi));
+	__nolibc_malloc_lock();
+	mi.arena    = stats->mapped - stats->large_mapped - stats->cached;
+	mi.hblks    = stats->large;
+	mi.hblkhd   = stats->large_mapped;
+	mi.usmblks  = stats->peak;
+	mi.uordblks = stats->live - stats->large_live;
+	mi.fordblks = mi.arena - mi.uordblks;
+	__nolibc_malloc_unlock();
+	return mi;
+}
+#endif /* NOLIBC_MALLOC_STATS */
+
 static __attribute__((unused))
 void *malloc(size_t len)
+{
+	return __nolibc_malloc(len, 0);
+}
+
+#if defined(NOLIBC_MALLOC_STATS)
+static void nolibc_malloc_stats_fd(int fd);
+
+/* dumps the allocator's counters to stderr */
+static __attribute__((unused))
+void malloc_stats(void)
+{
+	nolibc_malloc_stats_fd(2);
+}
+#endif /* NOLIBC_MALLOC_STATS */
+
+static __attribute__((unused))
+void *memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+/* Returns a large block of <len> bytes backed by huge pages if possible, or
+ * NULL if no memory is available. The block is handled by free() and realloc()
+ * like any other one.
+ */
+static __attribute__((unused))
+void *nolibc_malloc_huge(size_t len)
 {
 	struct nolibc_heap *heap;
+	size_t size;
 
-	/* Always allocate memory with size multiple of 4096. */
-	len  = sizeof(*heap) + len;
-	len  = (len + 4095UL) & -4096UL;
-	heap = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE,
-		    -1, 0);
-	if (__builtin_expect(heap == MAP_FAILED, 0))
+	if (__builtin_expect(len > -NOLIBC_MALLOC_HUGE_PAGE - sizeof(*heap), 0)) {
+		SET_ERRNO(ENOMEM);
 		return NULL;
+	}
 
-	heap->len = len;
+	size = sizeof(*heap) + len;
+	size = (size + NOLIBC_MALLOC_HUGE_PAGE - 1) & -NOLIBC_MALLOC_HUGE_PAGE;
+	__nolibc_malloc_lock();
+	heap = sys_mmap(NULL, size, PROT_READ|PROT_WRITE,
+			MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, -1, 0);
+	__NOLIBC_MALLOC_STAT(mmap_calls++);
+	if ((unsigned long)heap < -4095UL) {
+		heap->len = size | NOLIBC_HEAP_HUGETLB;
+		goto out;
+	}
+
+	/* no hugetlb page available, let THP back an aligned area */
+	heap = __nolibc_mmap_aligned(size, NOLIBC_MALLOC_HUGE_PAGE, 0);
+	if (__builtin_expect(heap == MAP_FAILED, 0)) {
+		__nolibc_malloc_unlock();
+		return NULL;
+	}
+
+	sys_madvise(heap, size, MADV_HUGEPAGE);
+	heap->len = size;
+ out:
+	__NOLIBC_MALLOC_STAT(mapped += size);
+#if defined(NOLIBC_MALLOC_STATS)
+	heap->req = len;
+#endif
+	__nolibc_malloc_count(heap->user_p, 1);
+	__nolibc_malloc_unlock();
 	return heap->user_p;
 }
 
+#if defined(NOLIBC_MALLOC_STATS)
+/* copies the allocator's counters into <stats> */
+static __attribute__((unused))
+void nolibc_malloc_get_stats(struct nolibc_malloc_stats *stats)
+{
+	__nolibc_malloc_lock();
+	*stats = __nolibc_malloc_state.stats;
+	__nolibc_malloc_unlock();
+}
+
+/* dumps the allocator's counters to file descriptor <fd> */
+static __attribute__((unused))
+void nolibc_malloc_stats_fd(int fd)
+{
+	struct nolibc_malloc_stats copy, *stats = &copy;
+	unsigned int cls;
+
+	nolibc_malloc_get_stats(stats);
+	dprintf(fd, "live bytes:   %lu\n", (unsigned long)stats->live);
+	dprintf(fd, "peak bytes:   %lu\n", (unsigned long)stats->peak);
+	dprintf(fd, "mapped bytes: %lu\n", (unsigned long)stats->mapped);
+	dprintf(fd, "large blocks: %lu (%lu bytes, %lu mapped, %lu lost to rounding)\n",
+		(unsigned long)stats->large, (unsigned long)stats->large_live,
+		(unsigned long)stats->large_mapped, (unsigned long)stats->slack);
+	dprintf(fd, "cached bytes: %lu (%lu hits)\n",
+		(unsigned long)stats->cached, stats->cache_hits);
+	dprintf(fd, "syscalls:     mmap %lu, munmap %lu, mremap %lu, brk %lu\n",
+		stats->mmap_calls, stats->munmap_calls, stats->mremap_calls, stats->brk_calls);
+	dprintf(fd, "  size\tallocs\tin use\n");
+	for (cls = 0; cls <= NOLIBC_MALLOC_CLASSES; cls++) {
+		if (cls < NOLIBC_MALLOC_CLASSES)
+			dprintf(fd, "%6u", __nolibc_malloc_class[cls]);
+		else
+			dprintf(fd, " >%4u", NOLIBC_MALLOC_SMALL_MAX);
+		dprintf(fd, "\t%lu\t%lu\n", stats->allocs[cls], stats->inuse[cls]);
+	}
+}
+#endif /* NOLIBC_MALLOC_STATS */
+
+static __attribute__((unused))
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ret;
+
+	if (!alignment || (alignment & (alignment - 1)) || (alignment % sizeof(void *)))
+		return EINVAL;
+
+	ret = aligned_alloc(alignment, size);
+	if (!ret)
+		return ENOMEM;
+
+	*memptr = ret;
+	return 0;
+}
+
 static __attribute__((unused))
 void *calloc(size_t size, size_t nmemb)
 {
@@ -170,24 +1498,70 @@ void *calloc(size_t size, size_t nmemb)
 	}
 
 	/*
-	 * No need to zero the heap, the MAP_ANONYMOUS in malloc()
-	 * already does it.
+	 * Slab objects, heap blocks and cached large blocks may be reused and
+	 * need to be zeroed. No need to zero newly mapped large blocks, the
+	 * MAP_ANONYMOUS already does it.
 	 */
-	return malloc(x);
+	return __nolibc_malloc(x, 1);
 }
 
 static __attribute__((unused))
 void *realloc(void *old_ptr, size_t new_size)
 {
 	struct nolibc_heap *heap;
-	size_t user_p_len;
+	size_t user_p_len, ofs, len;
 	void *ret;
 
 	if (!old_ptr)
 		return malloc(new_size);
 
-	heap = container_of(old_ptr, struct nolibc_heap, user_p);
-	user_p_len = heap->len - sizeof(*heap);
+	heap = __nolibc_malloc_hdr(old_ptr);
+	if (!__nolibc_blk_owns(old_ptr) && !(heap->len & (1 | NOLIBC_HEAP_HUGETLB))) {
+		/*
+		 * Large block: release the tail pages when shrinking, and let
+		 * the kernel extend or move the mapping when growing, which
+		 * never copies the contents. Blocks from the hugetlb pool
+		 * cannot be resized this way and are copied.
+		 */
+		ofs = (char *)old_ptr - (char *)heap;
+		if (__builtin_expect(new_size > -NOLIBC_MALLOC_PAGE - ofs, 0)) {
+			SET_ERRNO(ENOMEM);
+			return NULL;
+		}
+
+		__nolibc_malloc_lock();
+		__nolibc_malloc_count(old_ptr, -1);
+		len = (ofs + new_size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+		if (len < heap->len) {
+			__NOLIBC_MALLOC_STAT(munmap_calls++);
+			if (sys_munmap((char *)heap + len, heap->len - len) == 0) {
+				__NOLIBC_MALLOC_STAT(mapped -= heap->len - len);
+				heap->len = len;
+			}
+		} else if (len > heap->len) {
+			ret = mremap(heap, heap->len, len, MREMAP_MAYMOVE, NULL);
+			__NOLIBC_MALLOC_STAT(mremap_calls++);
+			if (__builtin_expect(ret == MAP_FAILED, 0)) {
+				/* still allocated, but not a new allocation */
+				__nolibc_malloc_count(old_ptr, 1);
+				__NOLIBC_MALLOC_STAT(allocs[NOLIBC_MALLOC_CLASSES]--);
+				__nolibc_malloc_unlock();
+				return NULL;
+			}
+			heap = ret;
+			__NOLIBC_MALLOC_STAT(mapped += len - heap->len);
+			heap->len = len;
+		}
+#if defined(NOLIBC_MALLOC_STATS)
+		heap->req = new_size;
+#endif
+		ret = (char *)heap + ofs;
+		__nolibc_malloc_count(ret, 1);
+		__nolibc_malloc_unlock();
+		return ret;
+	}
+
+	user_p_len = __nolibc_malloc_size(old_ptr);
 	/*
 	 * Don't realloc() if @user_p_len >= @new_size, this block of
 	 * memory is still enough to handle the @new_size. Just return
@@ -200,8 +1574,8 @@ void *realloc(void *old_ptr, size_t new_size)
 	if (__builtin_expect(!ret, 0))
 		return NULL;
 
-	memcpy(ret, heap->user_p, user_p_len);
-	munmap(heap, heap->len);
+	memcpy(ret, old_ptr, user_p_len);
+	free(old_ptr);
 	return ret;
 }
 
@@ -33,21 +33,446 @@
 #include "std.h"
 
 static void *malloc(size_t len);
+size_t strlen(const char *str);
+
+/* Types used to access memory one word at a time. The second one may be used
+ * at any alignment, which is only efficient when the architecture defines
+ * NOLIBC_ARCH_HAS_UNALIGNED_ACCESS.
+ */
+typedef unsigned long __nolibc_word __attribute__((__may_alias__));
+typedef unsigned long __nolibc_uword __attribute__((__may_alias__, __aligned__(1)));
+
+/* Architectures may provide versions of some functions which rely on CPU
+ * extensions only known at run time. For each of them, they define
+ * NOLIBC_ARCH_DISPATCH_<NAME> and a pointer __nolibc_<name>_fn, which their
+ * __nolibc_cpu_bind() sets at startup (see cpu.h). The generic version below
+ * is used as long as the pointer is NULL.
+ */
+
+/* a word with all bytes set to 0x01, multiplying a byte repeats it in a word */
+#define __NOLIBC_WORD_ONES (~0UL / 0xff)
+
+/* Returns non-zero if word <x> contains a zero byte. Bytes above the first zero
+ * one may be reported as well, so the exact position must be found by looking
+ * at the bytes. Scanning aligned words is always safe, because an aligned word
+ * never spans two pages.
+ */
+static __inline__ __attribute__((unused))
+unsigned long __nolibc_word_haszero(unsigned long x)
+{
+	return (x - __NOLIBC_WORD_ONES) & ~x & (__NOLIBC_WORD_ONES << 7);
+}
+
+/* Returns the number of leading bytes of <p1> and <p2>, <n> bytes long, which
+ * were found equal while comparing them one word at a time. The remaining ones
+ * start with a differing word or are fewer than a word long, and must be
+ * compared one at a time.
+ */
+static __inline__ __attribute__((unused))
+size_t __nolibc_memcmp_words(const unsigned char *p1, const unsigned char *p2, size_t n)
+{
+	size_t ofs;
+
+	if (n < sizeof(long))
+		return 0;
+
+#ifndef NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+	/* words may only be compared if both areas are aligned alike */
+	if (((unsigned long)p1 ^ (unsigned long)p2) & (sizeof(long) - 1))
+		return 0;
+#endif
+
+	for (ofs = 0; (unsigned long)(p1 + ofs) & (sizeof(long) - 1); ofs++)
+		if (p1[ofs] != p2[ofs])
+			return ofs;
+
+	for (; n - ofs >= sizeof(long); ofs += sizeof(long))
+		if (*(const __nolibc_word *)(p1 + ofs) != *(const __nolibc_uword *)(p2 + ofs))
+			break;
+	return ofs;
+}
 
 /*
  * As much as possible, please keep functions alphabetically sorted.
  */
 
+/* Returns zero if the <n> bytes at <s1> and <s2> are equal, non-zero
+ * otherwise, without telling which one is greater. Must be exported, as clang
+ * turns equality tests on memcmp() into calls to it.
+ */
+int bcmp(const void *s1, const void *s2, size_t n);
+__attribute__((weak,unused,section(".text.nolibc_bcmp")))
+int bcmp(const void *s1, const void *s2, size_t n)
+{
+#ifdef NOLIBC_ARCH_HAS_MEMCMP
+	return memcmp(s1, s2, n);
+#else
+	const unsigned char *p1 = s1, *p2 = s2;
+	size_t ofs;
+
+	for (ofs = __nolibc_memcmp_words(p1, p2, n); ofs < n; ofs++)
+		if (p1[ofs] != p2[ofs])
+			return 1;
+	return 0;
+#endif
+}
+
+#ifndef NOLIBC_ARCH_HAS_MEMCHR
 static __attribute__((unused))
+void *memchr(const void *s, int c, size_t len)
+{
+	const unsigned long mask = (unsigned char)c * __NOLIBC_WORD_ONES;
+	const unsigned char *p = s;
+
+#ifdef NOLIBC_ARCH_DISPATCH_MEMCHR
+	if (__nolibc_memchr_fn)
+		return __nolibc_memchr_fn(s, c, len);
+#endif
+
+	for (; len && ((unsigned long)p & (sizeof(long) - 1)); p++, len--)
+		if (*p == (unsigned char)c)
+			return (void *)p;
+
+	for (; len >= sizeof(long); p += sizeof(long), len -= sizeof(long))
+		if (__nolibc_word_haszero(*(const __nolibc_word *)p ^ mask))
+			break;
+
+	for (; len; p++, len--)
+		if (*p == (unsigned char)c)
+			return (void *)p;
+	return NULL;
+}
+#endif /* #ifndef NOLIBC_ARCH_HAS_MEMCHR */
+
+#ifndef NOLIBC_ARCH_HAS_MEMCMP
+/* might be ignored by the compiler without -ffreestanding, then found as
+ * missing, and gcc turns bcmp() into memcmp().
+ */
+int memcmp(const void *s1, const void *s2, size_t n);
+__attribute__((weak,unused,section(".text.nolibc_memcmp")))
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-	size_t ofs = 0;
-	int c1 = 0;
+	const unsigned char *p1 = s1, *p2 = s2;
+	size_t ofs;
+
+	for (ofs = __nolibc_memcmp_words(p1, p2, n); ofs < n; ofs++)
+		if (p1[ofs] != p2[ofs])
+			return p1[ofs] - p2[ofs];
+	return 0;
+}
+#endif /* #ifndef NOLIBC_ARCH_HAS_MEMCMP */
+
+/* Needles up to this length are searched by looking for their first and last
+ * bytes, several positions at a time, before comparing the rest, and longer
+ * ones with the Two-Way algorithm.
+ */
+#define __NOLIBC_SHORT_NEEDLE 16
+
+#define __NOLIBC_SEARCH_STR   1 /* haystack ends at the first zero */
+#define __NOLIBC_SEARCH_ICASE 2 /* ignore ASCII case */
+
+/* returns <c> in lower case if <icase> is set, otherwise <c> */
+static __inline__ __attribute__((unused))
+unsigned char __nolibc_fold(unsigned char c, int icase)
+{
+	return (icase && (unsigned char)(c - 'A') < 26) ? c | 0x20 : c;
+}
+
+/* Returns the first occurrence of needle <n> of <l> bytes, 2 to
+ * __NOLIBC_SHORT_NEEDLE, in the <hl> bytes at <h>, or NULL. Each step checks
+ * the candidate positions of a whole word at once for both the first and the
+ * last bytes of the needle, which leaves few candidates to compare.
+ */
+static __attribute__((unused))
+void *__nolibc_memmem_short(const unsigned char *h, size_t hl, const unsigned char *n, size_t l)
+{
+	const unsigned long first = n[0] * __NOLIBC_WORD_ONES;
+	const unsigned long last = n[l - 1] * __NOLIBC_WORD_ONES;
+	size_t i, j;
+
+	for (i = 0; hl - i >= l - 1 + sizeof(long); i += sizeof(long)) {
+		if (!__nolibc_word_haszero((*(const __nolibc_uword *)(h + i) ^ first) |
+					   (*(const __nolibc_uword *)(h + i + l - 1) ^ last)))
+			continue;
+		for (j = i; j < i + sizeof(long); j++)
+			if (h[j] == n[0] && h[j + l - 1] == n[l - 1] && !bcmp(h + j + 1, n + 1, l - 2))
+				return (void *)(h + j);
+	}
+
+	for (; hl - i >= l; i++)
+		if (h[i] == n[0] && h[i + l - 1] == n[l - 1] && !bcmp(h + i + 1, n + 1, l - 2))
+			return (void *)(h + i);
+	return NULL;
+}
+
+/* Returns the start minus one of the maximal suffix of needle <n> of <l> bytes,
+ * for the reverse byte order if <rev> is set, and stores its period in <per>.
+ */
+static __attribute__((unused))
+size_t __nolibc_maxsuf(const unsigned char *n, size_t l, int icase, int rev, size_t *per)
+{
+	size_t ip = -1, jp = 0, k = 1, p = 1;
+	unsigned char a, b;
+
+	while (jp + k < l) {
+		a = __nolibc_fold(n[ip + k], icase);
+		b = __nolibc_fold(n[jp + k], icase);
+		if (a == b) {
+			if (k == p) {
+				jp += p;
+				k = 1;
+			} else
+				k++;
+		} else if ((a > b) != rev) {
+			jp += k;
+			k = 1;
+			p = jp - ip;
+		} else {
+			ip = jp++;
+			k = p = 1;
+		}
+	}
+	*per = p;
+	return ip;
+}
+
+/* Returns the first occurrence of needle <n> of <l> bytes in haystack <h>, or
+ * NULL, using the Two-Way algorithm which runs in linear time and constant
+ * space. The haystack ends at <z>, or with __NOLIBC_SEARCH_STR at its first
+ * zero, which is then only looked for as the search progresses starting from
+ * <z>. Bytes skipped when the last one of the window does not match are taken
+ * from a shift table, as in Horspool's algorithm. With __NOLIBC_SEARCH_ICASE,
+ * ASCII letters match regardless of their case.
+ */
+static __attribute__((unused))
+void *__nolibc_twoway(const unsigned char *h, const unsigned char *z,
+		      const unsigned char *n, size_t l, int flags)
+{
+	const int icase = flags & __NOLIBC_SEARCH_ICASE;
+	unsigned long byteset[256 / (8 * sizeof(long))] = { 0 };
+	size_t shift[256];
+	const unsigned char *end;
+	size_t i, k, p, p0, ms, mem, mem0;
+	unsigned char a;
+
+	for (i = 0; i < l; i++) {
+		a = __nolibc_fold(n[i], icase);
+		byteset[a / (8 * sizeof(long))] |= 1UL << (a % (8 * sizeof(long)));
+		shift[a] = i + 1;
+	}
+
+	/* split the needle at the longest of its maximal suffixes for both
+	 * byte orders, <p> being the period of the right part.
+	 */
+	ms = __nolibc_maxsuf(n, l, icase, 0, &p0);
+	i = __nolibc_maxsuf(n, l, icase, 1, &p);
+	if (i + 1 > ms + 1)
+		ms = i;
+	else
+		p = p0;
+
+	/* a periodic needle allows to remember how much of it already matched.
+	 * <ms> is -1 when the left part is empty, hence the <ms + 1> bounds.
+	 */
+	for (i = 0; i < ms + 1; i++)
+		if (__nolibc_fold(n[i], icase) != __nolibc_fold(n[i + p], icase))
+			break;
+	if (i < ms + 1) {
+		mem0 = 0;
+		p = ((ms + 1 > l - ms - 1) ? ms : l - ms - 1) + 1;
+	} else
+		mem0 = l - p;
+	mem = 0;
+
+	for (;;) {
+		if ((size_t)(z - h) < l) {
+			if (!(flags & __NOLIBC_SEARCH_STR))
+				return NULL;
+			end = memchr(z, 0, l | 63);
+			if (end) {
+				flags &= ~__NOLIBC_SEARCH_STR;
+				z = end;
+				if ((size_t)(z - h) < l)
+					return NULL;
+			} else
+				z += l | 63;
+		}
+
+		a = __nolibc_fold(h[l - 1], icase);
+		if (!(byteset[a / (8 * sizeof(long))] & (1UL << (a % (8 * sizeof(long)))))) {
+			h += l;
+			mem = 0;
+			continue;
+		}
+		k = l - shift[a];
+		if (k) {
+			h += k < mem ? mem : k;
+			mem = 0;
+			continue;
+		}
+
+		/* compare the right part, then the left one */
+		for (k = ms + 1 > mem ? ms + 1 : mem; k < l; k++)
+			if (__nolibc_fold(n[k], icase) != __nolibc_fold(h[k], icase))
+				break;
+		if (k < l) {
+			h += k - ms;
+			mem = 0;
+			continue;
+		}
+
+		for (k = ms + 1; k > mem; k--)
+			if (__nolibc_fold(n[k - 1], icase) != __nolibc_fold(h[k - 1], icase))
+				break;
+		if (k <= mem)
+			return (void *)h;
+		h += p;
+		mem = mem0;
+	}
+}
+
+/* Returns the first occurrence of the <nl> bytes at <needle> in the <hl> bytes
+ * at <haystack>, or NULL. An empty needle matches at <haystack>.
+ */
+static __attribute__((unused))
+void *memmem(const void *haystack, size_t hl, const void *needle, size_t nl)
+{
+	const unsigned char *h = haystack, *n = needle;
+
+	if (!nl)
+		return (void *)h;
+	if (nl > hl)
+		return NULL;
+	if (nl == 1)
+		return memchr(h, n[0], hl);
+	if (nl <= __NOLIBC_SHORT_NEEDLE)
+		return __nolibc_memmem_short(h, hl, n, nl);
+	return __nolibc_twoway(h, h + hl, n, nl, 0);
+}
+
+/* Merges the end of aligned word <w0> starting at bit <sh> with the beginning
+ * of the following word <w1>, to rebuild an unaligned word read in memory.
+ * <sh> must not be zero.
+ */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define __nolibc_word_merge(w0, w1, sh) (((w0) << (sh)) | ((w1) >> (8 * sizeof(long) - (sh))))
+#else
+#define __nolibc_word_merge(w0, w1, sh) (((w0) >> (sh)) | ((w1) << (8 * sizeof(long) - (sh))))
+#endif
+
+/* Copies <len> bytes from <s> to <d> by increasing addresses, which is fine
+ * for overlapping areas as long as <d> is below <s>. Once <d> is aligned, the
+ * copy is done by words. If <s> is then not aligned and the architecture does
+ * not support unaligned accesses, source words are read aligned and merged.
+ * The asm() statements in the loops prevent the compiler from turning them
+ * into a call to memcpy(), which may be this function's caller.
+ */
+static __attribute__((unused))
+void __nolibc_memcpy_fwd(unsigned char *d, const unsigned char *s, size_t len)
+{
+	__nolibc_word *wd;
+	unsigned long w0, w1;
+
+	if (len >= 2 * sizeof(long)) {
+		for (; (unsigned long)d & (sizeof(long) - 1); len--) {
+			__asm__("");
+			*d++ = *s++;
+		}
+
+		wd = (__nolibc_word *)d;
+#ifndef NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+		if ((unsigned long)s & (sizeof(long) - 1)) {
+			unsigned int sh = ((unsigned long)s & (sizeof(long) - 1)) * 8;
+			const __nolibc_word *ws = (const __nolibc_word *)(s - sh / 8);
+
+			for (w0 = *ws; len >= sizeof(long); len -= sizeof(long), s += sizeof(long)) {
+				__asm__("");
+				w1 = *++ws;
+				*wd++ = __nolibc_word_merge(w0, w1, sh);
+				w0 = w1;
+			}
+		}
+#endif
+		for (; len >= 4 * sizeof(long); len -= 4 * sizeof(long), s += 4 * sizeof(long), wd += 4) {
+			__asm__("");
+			w0 = ((const __nolibc_uword *)s)[0];
+			w1 = ((const __nolibc_uword *)s)[1];
+			wd[0] = w0;
+			wd[1] = w1;
+			w0 = ((const __nolibc_uword *)s)[2];
+			w1 = ((const __nolibc_uword *)s)[3];
+			wd[2] = w0;
+			wd[3] = w1;
+		}
+		for (; len >= sizeof(long); len -= sizeof(long), s += sizeof(long)) {
+			__asm__("");
+			*wd++ = *(const __nolibc_uword *)s;
+		}
+		d = (unsigned char *)wd;
+	}
 
-	while (ofs < n && !(c1 = ((unsigned char *)s1)[ofs] - ((unsigned char *)s2)[ofs])) {
-		ofs++;
+	while (len--) {
+		__asm__("");
+		*d++ = *s++;
+	}
+}
+
+/* Same as __nolibc_memcpy_fwd() by decreasing addresses, for overlapping areas
+ * where <d> is above <s>.
+ */
+static __attribute__((unused))
+void __nolibc_memcpy_bwd(unsigned char *d, const unsigned char *s, size_t len)
+{
+	__nolibc_word *wd;
+	unsigned long w0, w1;
+
+	d += len;
+	s += len;
+	if (len >= 2 * sizeof(long)) {
+		for (; (unsigned long)d & (sizeof(long) - 1); len--) {
+			__asm__("");
+			*--d = *--s;
+		}
+
+		wd = (__nolibc_word *)d;
+#ifndef NOLIBC_ARCH_HAS_UNALIGNED_ACCESS
+		if ((unsigned long)s & (sizeof(long) - 1)) {
+			unsigned int sh = ((unsigned long)s & (sizeof(long) - 1)) * 8;
+			const __nolibc_word *ws = (const __nolibc_word *)(s - sh / 8);
+
+			for (w1 = *ws; len >= sizeof(long); len -= sizeof(long), s -= sizeof(long)) {
+				__asm__("");
+				w0 = *--ws;
+				*--wd = __nolibc_word_merge(w0, w1, sh);
+				w1 = w0;
+			}
+		}
+#endif
+		for (; len >= 4 * sizeof(long); len -= 4 * sizeof(long)) {
+			__asm__("");
+			s -= 4 * sizeof(long);
+			wd -= 4;
+			w0 = ((const __nolibc_uword *)s)[3];
+			w1 = ((const __nolibc_uword *)s)[2];
+			wd[3] = w0;
+			wd[2] = w1;
+			w0 = ((const __nolibc_uword *)s)[1];
+			w1 = ((const __nolibc_uword *)s)[0];
+			wd[1] = w0;
+			wd[0] = w1;
+		}
+		for (; len >= sizeof(long); len -= sizeof(long)) {
+			__asm__("");
+			s -= sizeof(long);
+			*--wd = *(const __nolibc_uword *)s;
+		}
+		d = (unsigned char *)wd;
+	}
+
+	while (len--) {
+		__asm__("");
+		*--d = *--s;
 	}
-	return c1;
 }
 
 #ifndef NOLIBC_ARCH_HAS_MEMMOVE
@@ -58,21 +483,10 @@ void *memmove(void *dst, const void *src, size_t len);
 __attribute__((weak,unused,section(".text.nolibc_memmove")))
 void *memmove(void *dst, const void *src, size_t len)
 {
-	size_t dir, pos;
-
-	pos = len;
-	dir = -1;
-
-	if (dst < src) {
-		pos = -1;
-		dir = 1;
-	}
-
-	while (len) {
-		pos += dir;
-		((char *)dst)[pos] = ((const char *)src)[pos];
-		len--;
-	}
+	if ((unsigned long)dst - (unsigned long)src < len)
+		__nolibc_memcpy_bwd(dst, src, len);
+	else
+		__nolibc_memcpy_fwd(dst, src, len);
 	return dst;
 }
 #endif /* #ifndef NOLIBC_ARCH_HAS_MEMMOVE */
@@ -83,16 +497,36 @@ void *memcpy(void *dst, const void *src, size_t len);
 __attribute__((weak,unused,section(".text.nolibc_memcpy")))
 void *memcpy(void *dst, const void *src, size_t len)
 {
-	size_t pos = 0;
-
-	while (pos < len) {
-		((char *)dst)[pos] = ((const char *)src)[pos];
-		pos++;
-	}
+#ifdef NOLIBC_ARCH_DISPATCH_MEMCPY
+	if (__nolibc_memcpy_fn)
+		return __nolibc_memcpy_fn(dst, src, len);
+#endif
+	__nolibc_memcpy_fwd(dst, src, len);
 	return dst;
 }
 #endif /* #ifndef NOLIBC_ARCH_HAS_MEMCPY */
 
+/* same as memchr() but from the end of the area */
+static __attribute__((unused))
+void *memrchr(const void *s, int c, size_t len)
+{
+	const unsigned long mask = (unsigned char)c * __NOLIBC_WORD_ONES;
+	const unsigned char *p = (const unsigned char *)s + len;
+
+	for (; len && ((unsigned long)p & (sizeof(long) - 1)); len--)
+		if (*--p == (unsigned char)c)
+			return (void *)p;
+
+	for (; len >= sizeof(long); p -= sizeof(long), len -= sizeof(long))
+		if (__nolibc_word_haszero(*(const __nolibc_word *)(p - sizeof(long)) ^ mask))
+			break;
+
+	while (len--)
+		if (*--p == (unsigned char)c)
+			return (void *)p;
+	return NULL;
+}
+
 #ifndef NOLIBC_ARCH_HAS_MEMSET
 /* might be ignored by the compiler without -ffreestanding, then found as
  * missing.
@@ -101,7 +535,34 @@ void *memset(void *dst, int b, size_t len);
 __attribute__((weak,unused,section(".text.nolibc_memset")))
 void *memset(void *dst, int b, size_t len)
 {
-	char *p = dst;
+	const unsigned long w = (unsigned char)b * __NOLIBC_WORD_ONES;
+	unsigned char *p = dst;
+	__nolibc_word *wp;
+
+#ifdef NOLIBC_ARCH_DISPATCH_MEMSET
+	if (__nolibc_memset_fn)
+		return __nolibc_memset_fn(dst, b, len);
+#endif
+
+	if (len >= 2 * sizeof(long)) {
+		for (; (unsigned long)p & (sizeof(long) - 1); len--) {
+			__asm__ volatile("");
+			*p++ = b;
+		}
+
+		for (wp = (__nolibc_word *)p; len >= 4 * sizeof(long); len -= 4 * sizeof(long), wp += 4) {
+			__asm__ volatile("");
+			wp[0] = w;
+			wp[1] = w;
+			wp[2] = w;
+			wp[3] = w;
+		}
+		for (; len >= sizeof(long); len -= sizeof(long)) {
+			__asm__ volatile("");
+			*wp++ = w;
+		}
+		p = (unsigned char *)wp;
+	}
 
 	while (len--) {
 		/* prevent gcc from recognizing memset() here */
@@ -112,27 +573,82 @@ void *memset(void *dst, int b, size_t len)
 }
 #endif /* #ifndef NOLIBC_ARCH_HAS_MEMSET */
 
+/* same as memchr() without a length, <c> must be present */
+static __attribute__((unused))
+void *rawmemchr(const void *s, int c)
+{
+	const unsigned long mask = (unsigned char)c * __NOLIBC_WORD_ONES;
+	const unsigned char *p = s;
+	const __nolibc_word *w;
+
+	for (; (unsigned long)p & (sizeof(long) - 1); p++)
+		if (*p == (unsigned char)c)
+			return (void *)p;
+
+	for (w = (const __nolibc_word *)p; !__nolibc_word_haszero(*w ^ mask); w++)
+		;
+
+	for (p = (const unsigned char *)w; *p != (unsigned char)c; p++)
+		;
+	return (void *)p;
+}
+
+/* Same as strstr() but ignores the case of ASCII letters. An empty needle
+ * matches at <haystack>.
+ */
+static __attribute__((unused))
+char *strcasestr(const char *haystack, const char *needle)
+{
+	const unsigned char *h = (const unsigned char *)haystack;
+	size_t l = strlen(needle);
+
+	if (!l)
+		return (char *)haystack;
+	return __nolibc_twoway(h, h, (const unsigned char *)needle, l,
+			       __NOLIBC_SEARCH_STR | __NOLIBC_SEARCH_ICASE);
+}
+
+#ifndef NOLIBC_ARCH_HAS_STRCHR
 static __attribute__((unused))
 char *strchr(const char *s, int c)
 {
-	while (*s) {
+	const unsigned long mask = (unsigned char)c * __NOLIBC_WORD_ONES;
+	const __nolibc_word *w;
+
+	for (; (unsigned long)s & (sizeof(long) - 1); s++) {
 		if (*s == (char)c)
 			return (char *)s;
-		s++;
+		if (!*s)
+			return NULL;
 	}
-	return NULL;
+
+	for (w = (const __nolibc_word *)s; !__nolibc_word_haszero(*w) && !__nolibc_word_haszero(*w ^ mask); w++)
+		;
+
+	for (s = (const char *)w; *s != (char)c; s++)
+		if (!*s)
+			return NULL;
+	return (char *)s;
 }
+#endif /* #ifndef NOLIBC_ARCH_HAS_STRCHR */
 
+#ifndef NOLIBC_ARCH_HAS_STRCMP
 static __attribute__((unused))
 int strcmp(const char *a, const char *b)
 {
 	unsigned int c;
 	int diff;
 
+#ifdef NOLIBC_ARCH_DISPATCH_STRCMP
+	if (__nolibc_strcmp_fn)
+		return __nolibc_strcmp_fn(a, b);
+#endif
+
 	while (!(diff = (unsigned char)*a++ - (c = (unsigned char)*b++)) && c)
 		;
 	return diff;
 }
+#endif /* #ifndef NOLIBC_ARCH_HAS_STRCMP */
 
 static __attribute__((unused))
 char *strcpy(char *dst, const char *src)
@@ -143,22 +659,38 @@ char *strcpy(char *dst, const char *src)
 	return ret;
 }
 
+#ifndef NOLIBC_ARCH_HAS_STRLEN
 /* this function is only used with arguments that are not constants or when
- * it's not known because optimizations are disabled. Note that gcc 12
- * recognizes an strlen() pattern and replaces it with a jump to strlen(),
- * thus itself, hence the asm() statement below that's meant to disable this
- * confusing practice.
+ * it's not known because optimizations are disabled. The string is checked one
+ * word at a time once aligned. Note that gcc 12 recognizes an strlen() pattern
+ * and replaces it with a jump to strlen(), thus itself, hence the asm()
+ * statement in the final byte loop that's meant to disable this confusing
+ * practice.
  */
 size_t strlen(const char *str);
 __attribute__((weak,unused,section(".text.nolibc_strlen")))
 size_t strlen(const char *str)
 {
-	size_t len;
+	const __nolibc_word *w;
+	const char *s;
 
-	for (len = 0; str[len]; len++)
+#ifdef NOLIBC_ARCH_DISPATCH_STRLEN
+	if (__nolibc_strlen_fn)
+		return __nolibc_strlen_fn(str);
+#endif
+
+	for (s = str; (unsigned long)s & (sizeof(long) - 1); s++)
+		if (!*s)
+			return s - str;
+
+	for (w = (const __nolibc_word *)s; !__nolibc_word_haszero(*w); w++)
+		;
+
+	for (s = (const char *)w; *s; s++)
 		__asm__("");
-	return len;
+	return s - str;
 }
+#endif /* #ifndef NOLIBC_ARCH_HAS_STRLEN */
 
 /* do not trust __builtin_constant_p() at -O0, as clang will emit a test and
  * the two branches, then will rely on an external definition of strlen().
@@ -172,14 +704,24 @@ size_t strlen(const char *str)
 })
 #endif
 
+#ifndef NOLIBC_ARCH_HAS_STRNLEN
 static __attribute__((unused))
 size_t strnlen(const char *str, size_t maxlen)
 {
 	size_t len;
 
-	for (len = 0; (len < maxlen) && str[len]; len++);
+	for (len = 0; len < maxlen && ((unsigned long)(str + len) & (sizeof(long) - 1)); len++)
+		if (!str[len])
+			return len;
+
+	for (; maxlen - len >= sizeof(long); len += sizeof(long))
+		if (__nolibc_word_haszero(*(const __nolibc_word *)(str + len)))
+			break;
+
+	for (; (len < maxlen) && str[len]; len++);
 	return len;
 }
+#endif /* #ifndef NOLIBC_ARCH_HAS_STRNLEN */
 
 static __attribute__((unused))
 char *strdup(const char *str)
@@ -301,34 +843,43 @@ char *strncpy(char *dst, const char *src, size_t size)
 static __attribute__((unused))
 char *strrchr(const char *s, int c)
 {
-	const char *ret = NULL;
-
-	while (*s) {
-		if (*s == (char)c)
-			ret = s;
-		s++;
-	}
-	return (char *)ret;
+	return memrchr(s, c, strlen(s) + 1);
 }
 
+/* Returns the first occurrence of string <needle> in string <haystack>, or
+ * NULL. An empty needle matches at <haystack>.
+ */
 static __attribute__((unused))
 char *strstr(const char *haystack, const char *needle)
 {
-	size_t len_haystack, len_needle;
-
-	len_needle = strlen(needle);
-	if (!len_needle)
-		return NULL;
-
-	len_haystack = strlen(haystack);
-	while (len_haystack >= len_needle) {
-		if (!memcmp(haystack, needle, len_needle))
-			return (char *)haystack;
-		haystack++;
-		len_haystack--;
+	const unsigned char *h = (const unsigned char *)haystack;
+	const unsigned char *n = (const unsigned char *)needle;
+	const unsigned char *z, *end;
+	void *ret;
+	size_t l;
+
+	l = strlen(needle);
+	if (!l)
+		return (char *)haystack;
+	if (l == 1)
+		return strchr(haystack, n[0]);
+	if (l > __NOLIBC_SHORT_NEEDLE)
+		return __nolibc_twoway(h, h, n, l, __NOLIBC_SEARCH_STR);
+
+	/* short needles are looked for in successive windows of the haystack,
+	 * each overlapping the previous one by the needle's length minus one.
+	 */
+	for (z = h; ; h = z - (l - 1)) {
+		end = memchr(z, 0, 4096);
+		z = end ? end : z + 4096;
+		if ((size_t)(z - h) >= l) {
+			ret = __nolibc_memmem_short(h, z - h, n, l);
+			if (ret)
+				return ret;
+		}
+		if (end)
+			return NULL;
 	}
-
-	return NULL;
 }
 
 static __attribute__((unused))
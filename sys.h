@@ -377,6 +377,27 @@ int fsync(int fd)
 }
 
 
+/*
+ * int ftruncate(int fd, off_t length);
+ */
+
+static __attribute__((unused))
+int sys_ftruncate(int fd, off_t length)
+{
+#ifdef __NR_ftruncate
+	return my_syscall2(__NR_ftruncate, fd, length);
+#else
+	return __nolibc_enosys(__func__, fd, length);
+#endif
+}
+
+static __attribute__((unused))
+int ftruncate(int fd, off_t length)
+{
+	return __sysret(sys_ftruncate(fd, length));
+}
+
+
 /*
  * int getdents64(int fd, struct linux_dirent64 *dirp, int count);
  */
@@ -13,6 +13,22 @@
 #include "../arch.h"
 #include "../sys.h"
 
+static __attribute__((unused))
+int sys_madvise(void *addr, size_t length, int advice)
+{
+#ifdef __NR_madvise
+	return my_syscall3(__NR_madvise, addr, length, advice);
+#else
+	return __nolibc_enosys(__func__, addr, length, advice);
+#endif
+}
+
+static __attribute__((unused))
+int madvise(void *addr, size_t length, int advice)
+{
+	return __sysret(sys_madvise(addr, length, advice));
+}
+
 #ifndef sys_mmap
 static __attribute__((unused))
 void *sys_mmap(void *addr, size_t length, int prot, int flags, int fd,
@@ -48,6 +64,22 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
 	return ret;
 }
 
+static __attribute__((unused))
+int sys_mprotect(void *addr, size_t length, int prot)
+{
+#ifdef __NR_mprotect
+	return my_syscall3(__NR_mprotect, addr, length, prot);
+#else
+	return __nolibc_enosys(__func__, addr, length, prot);
+#endif
+}
+
+static __attribute__((unused))
+int mprotect(void *addr, size_t length, int prot)
+{
+	return __sysret(sys_mprotect(addr, length, prot));
+}
+
 static __attribute__((unused))
 void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address)
 {
@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: LGPL-2.1 OR MIT */
+/*
+ * Virtual memory reservation for NOLIBC
+ */
+
+/* make sure to include all global symbols */
+#include "nolibc.h"
+
+#ifndef _NOLIBC_VM_H
+#define _NOLIBC_VM_H
+
+#include "std.h"
+#include "errno.h"
+#include "sys/mman.h"
+#include "string.h"
+#include "stdlib.h"
+
+/* An address range may be reserved without consuming any memory by mapping it
+ * with PROT_NONE, and its pages committed later with mprotect() as they are
+ * needed. Data placed there never has to move, however large it grows. A
+ * struct nolibc_vmbuf uses this to implement a growable buffer suitable for
+ * vectors or strings: its base address remains the same during its whole
+ * life, and growing it never copies anything. The committed part grows by
+ * doubling, but by no less than NOLIBC_VMBUF_STEP bytes, which limits the
+ * number of mprotect() calls. Committed memory is zeroed the first time it is
+ * used.
+ */
+
+#ifndef NOLIBC_VMBUF_STEP
+#define NOLIBC_VMBUF_STEP 65536
+#endif
+
+struct nolibc_vmbuf {
+	char	*base;		/* start of the reserved range */
+	size_t	len;		/* bytes used */
+	size_t	committed;	/* bytes accessible from <base> */
+	size_t	reserved;	/* size of the reserved range */
+};
+
+/* Reserves <size> bytes of address space, rounded up to the page size, which
+ * are not accessible until committed. Returns NULL on failure.
+ */
+static __attribute__((unused))
+void *nolibc_vm_reserve(size_t size)
+{
+	void *ret;
+
+	size = (size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	ret = mmap(NULL, size, PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_NORESERVE, -1, 0);
+	if (ret == MAP_FAILED)
+		return NULL;
+	return ret;
+}
+
+/* Makes the pages covering <len> bytes at <addr> in a reserved range readable
+ * and writable. Returns 0 on success or -1 with errno set.
+ */
+static __attribute__((unused))
+int nolibc_vm_commit(void *addr, size_t len)
+{
+	char *start = (char *)((unsigned long)addr & -NOLIBC_MALLOC_PAGE);
+	char *end = (char *)(((unsigned long)addr + len + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE);
+
+	return mprotect(start, end - start, PROT_READ|PROT_WRITE);
+}
+
+/* Returns the pages fully contained in the <len> bytes at <addr> to the
+ * system and makes them inaccessible again. Returns 0 on success or -1 with
+ * errno set.
+ */
+static __attribute__((unused))
+int nolibc_vm_decommit(void *addr, size_t len)
+{
+	char *start = (char *)(((unsigned long)addr + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE);
+	char *end = (char *)(((unsigned long)addr + len) & -NOLIBC_MALLOC_PAGE);
+
+	if (end <= start)
+		return 0;
+	if (madvise(start, end - start, MADV_DONTNEED) < 0)
+		return -1;
+	return mprotect(start, end - start, PROT_NONE);
+}
+
+/* releases the range of <size> bytes at <addr> returned by nolibc_vm_reserve() */
+static __attribute__((unused))
+int nolibc_vm_release(void *addr, size_t size)
+{
+	return munmap(addr, (size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE);
+}
+
+/* Prepares empty buffer <buf> to grow up to <max> bytes. Nothing is committed
+ * yet. Returns 0 on success or -1 with errno set.
+ */
+static __attribute__((unused))
+int nolibc_vmbuf_init(struct nolibc_vmbuf *buf, size_t max)
+{
+	max = (max + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	buf->base = nolibc_vm_reserve(max);
+	if (!buf->base)
+		return -1;
+
+	buf->len = 0;
+	buf->committed = 0;
+	buf->reserved = max;
+	return 0;
+}
+
+/* Makes sure that <len> more bytes may be written at the end of buffer <buf>.
+ * Returns 0 on success, or -1 with errno set to ENOMEM if the reserved range
+ * is too small or the pages could not be committed.
+ */
+static __attribute__((unused))
+int nolibc_vmbuf_reserve(struct nolibc_vmbuf *buf, size_t len)
+{
+	size_t need, size;
+
+	if (__builtin_expect(len <= buf->committed - buf->len, 1))
+		return 0;
+
+	if (len > buf->reserved - buf->len) {
+		SET_ERRNO(ENOMEM);
+		return -1;
+	}
+
+	need = buf->len + len;
+	size = buf->committed * 2;
+	if (size < buf->committed + NOLIBC_VMBUF_STEP)
+		size = buf->committed + NOLIBC_VMBUF_STEP;
+	if (size < need)
+		size = need;
+	size = (size + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+	if (size > buf->reserved)
+		size = buf->reserved;
+
+	if (nolibc_vm_commit(buf->base + buf->committed, size - buf->committed) < 0)
+		return -1;
+
+	buf->committed = size;
+	return 0;
+}
+
+/* Appends <len> uninitialized bytes to buffer <buf> and returns their address,
+ * or NULL if the buffer cannot grow that much. This is how vectors grow by one
+ * or more elements.
+ */
+static __attribute__((unused))
+void *nolibc_vmbuf_grow(struct nolibc_vmbuf *buf, size_t len)
+{
+	void *ret;
+
+	if (nolibc_vmbuf_reserve(buf, len) < 0)
+		return NULL;
+
+	ret = buf->base + buf->len;
+	buf->len += len;
+	return ret;
+}
+
+/* Appends the <len> bytes at <data> to buffer <buf>. Returns 0 on success or
+ * -1 with errno set.
+ */
+static __attribute__((unused))
+int nolibc_vmbuf_append(struct nolibc_vmbuf *buf, const void *data, size_t len)
+{
+	void *ptr = nolibc_vmbuf_grow(buf, len);
+
+	if (!ptr)
+		return -1;
+	memcpy(ptr, data, len);
+	return 0;
+}
+
+/* Appends string <str> to buffer <buf>, which is always left terminated by a
+ * zero not counted in its length, so that <buf->base> may be used as a string.
+ * Returns 0 on success or -1 with errno set.
+ */
+static __attribute__((unused))
+int nolibc_vmbuf_puts(struct nolibc_vmbuf *buf, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (nolibc_vmbuf_reserve(buf, len + 1) < 0)
+		return -1;
+	memcpy(buf->base + buf->len, str, len + 1);
+	buf->len += len;
+	return 0;
+}
+
+/* Shrinks buffer <buf> to <len> bytes, and returns the pages following them to
+ * the system. Returns 0 on success or -1 with errno set.
+ */
+static __attribute__((unused))
+int nolibc_vmbuf_truncate(struct nolibc_vmbuf *buf, size_t len)
+{
+	size_t keep = (len + NOLIBC_MALLOC_PAGE - 1) & -NOLIBC_MALLOC_PAGE;
+
+	if (len < buf->len)
+		buf->len = len;
+	if (keep >= buf->committed)
+		return 0;
+	if (nolibc_vm_decommit(buf->base + keep, buf->committed - keep) < 0)
+		return -1;
+	buf->committed = keep;
+	return 0;
+}
+
+/* releases all the memory of buffer <buf> */
+static __attribute__((unused))
+void nolibc_vmbuf_free(struct nolibc_vmbuf *buf)
+{
+	nolibc_vm_release(buf->base, buf->reserved);
+	buf->base = NULL;
+	buf->len = buf->committed = buf->reserved = 0;
+}
+
+#endif /* _NOLIBC_VM_H */